@@ -1,5 +1,5 @@
 /* Biblioteki, kolory oraz makrosy */
-#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -7,17 +7,92 @@
 #include <errno.h>
 #include <sys/wait.h>
 #include <signal.h>
-#include <ctype.h>
+#include <spawn.h>
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <utime.h>
 #include <time.h>
+#include <sys/sendfile.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include <stdint.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
 #define PATH_MAX_LEN 1024
-#define MAX_CMD_LEN 1024
-#define MAX_ARGS 64
+#define ARENA_BLOCK_MIN 4096
+#define ARENA_ALIGN     16
+#define ARGS_INITIAL    16
 #define FILE_BUF_SIZE 16384
 #define HISTORY_MAX 20
+#define CP_CHUNK_MAX (1 << 30)
+
+#define CP_NONE             0
+#define CP_COPY_FILE_RANGE  1
+#define CP_SENDFILE         2
+#define CP_READ_WRITE       3
+#define CP_REFLINK          4
+#define CP_IO_URING         5
+#define CP_SPLICE           6
+#define CP_TEE              7
+
+#define REFLINK_AUTO    0
+#define REFLINK_ALWAYS  1
+#define REFLINK_NEVER   2
+
+#define CP_POOL_MAX 64
+
+#define CP_BUF_MAX      (8 << 20)
+#define HUGE_PAGE_SIZE  (2 << 20)
+#define CP_CACHE_WINDOW (64 << 20)
+#define DIRECT_ALIGN    4096
+
+#define PROGRESS_INTERVAL_US 500000
+#define RESUME_BLOCK    (64 << 20)
+#define JOURNAL_SUFFIX  ".cpjournal"
+#define JOURNAL_MAGIC   "microshell-cp-journal"
+
+#define CRC32C_POLY     0x82F63B78U
+
+#define HASH_PRIME1     0x9E3779B185EBCA87UL
+#define HASH_PRIME2     0xC2B2AE3D27D4EB4FUL
+
+#define PATH_BUCKETS    64
+#define JOBS_MAX        32
+#define MAX_REDIRS      8
+#define PIPE_BIG_SIZE   (1 << 20)
+
+#define BI_EXIT         1
+#define BI_NO_OPTIONS   2
+
+#define BI_GROUP_CORE   1
+#define BI_GROUP_EXTRA  2
+#define BI_GROUP_OWN    3
+
+#define PROC_RUNNING    0
+#define PROC_STOPPED    1
+#define PROC_DONE       2
+
+#define AST_END         0
+#define AST_SEQ         1
+#define AST_AND         2
+#define AST_OR          3
+#define AST_BG          4
+
+#define AST_CACHE_SIZE      64
+#define AST_CACHE_LINE_MAX  4096
+
+#define URING_DEPTH     8
+#define URING_BUF_SIZE  (1 << 20)
+#define URING_MIN_SIZE  (8 << 20)
 
 #define C_RED       "\033[1;31m"
 #define C_GREEN     "\033[1;32m"
@@ -25,27 +100,392 @@
 #define C_RESET     "\033[0m"
 #define C_CLEAR     "\033[H\033[J"
 
-char history_list[HISTORY_MAX][MAX_CMD_LEN];
+char *history_list[HISTORY_MAX];
 int history_count = 0;
 
+/* Arena poleceń: linia, argumenty i tablice potoku jednego polecenia są przydzielane
+   przez przesunięcie wskaźnika, bloki rosną dwukrotnie, całość zwalnia arena_reset() */
+struct arena_block
+{
+    struct arena_block *next;
+    size_t size;
+    size_t used;
+};
+
+struct arena
+{
+    struct arena_block *head;
+};
+
+struct arena cmd_arena;
+
+/* Polecenie wbudowane: nazwa, funkcja, flagi oraz opis dla help */
+struct builtin
+{
+    const char *name;
+    int (*handler)(char **args);
+    int flags;
+    int group;
+    const char *usage;
+    const char *description;
+};
+
+/* Operatory jako osobne tokeny: rozpoznawane po adresie, więc "|" w cudzysłowie pozostaje słowem */
+const char op_pipe[] = "|";
+const char op_in[] = "<";
+const char op_out[] = ">";
+const char op_append[] = ">>";
+const char op_err[] = "2>";
+const char op_err_out[] = "2>&1";
+const char op_out_err[] = "&>";
+const char op_bg[] = "&";
+const char op_and[] = "&&";
+const char op_or[] = "||";
+const char op_seq[] = ";";
+
+/* Przekierowanie: deskryptor fd otwierany z pliku path (flags) albo kopia dup_fd */
+struct redirect
+{
+    int fd;
+    const char *path;
+    int flags;
+    int dup_fd;
+};
+
+struct redirects
+{
+    int count;
+    struct redirect list[MAX_REDIRS];
+};
+
+/* $? po parsowaniu: miejsce w słowie zapisane poza jego tekstem (słowo samo nie zawiera
+   "$?"), rozwijane dopiero przy wykonaniu, bo drzewo z pamięci podręcznej jest używane
+   wielokrotnie; znaczniki jednego słowa leżą obok siebie w kolejności przesunięć */
+struct param_mark
+{
+    const char *word;
+    size_t offset;
+};
+
+struct param_marks
+{
+    int count;
+    struct param_mark *list;
+};
+
+/* Drzewo składniowe linii: lista potoków połączonych operatorami ; && || &
+   (connector - operator po danym potoku), potok to ciąg prostych poleceń; drzewo
+   może być wykonane wiele razy (ast_cache), więc polecenia nie zmieniają napisów argv */
+struct ast_command
+{
+    char **argv;
+    struct redirects redirs;
+    const struct param_marks *params;
+};
+
+struct ast_pipeline
+{
+    int count;
+    struct ast_command *commands;
+    int connector;
+    char *text;
+};
+
+struct ast
+{
+    int count;
+    struct ast_pipeline *pipelines;
+    struct param_marks params;
+};
+
+int last_status = 0;
+int exit_requested = 0;
+int opt_pipefail = 0;
+int opt_bigpipe = 0;
+
+/* Zadanie (job): grupa procesów jednego potoku; stany procesów aktualizuje obsługa SIGCHLD */
+struct job
+{
+    int id;
+    pid_t pgid;
+    int count;
+    pid_t *pids;
+    volatile sig_atomic_t *states;
+    volatile sig_atomic_t *statuses;
+    char *command;
+};
+
+struct job job_table[JOBS_MAX];
+int job_control = 0;
+pid_t shell_pgid = 0;
+
+/* Tabela poleceń wbudowanych (definicja przy find_builtin) */
+extern const struct builtin builtins[];
+extern const size_t builtin_count;
+
+/* Pamięć podręczna ścieżek poleceń (hash): nazwa -> pełna ścieżka z PATH */
+struct path_entry
+{
+    char *name;
+    char *path;
+    int dir;
+    int hits;
+    struct path_entry *next;
+};
+
+struct path_entry *path_table[PATH_BUCKETS];
+char *path_env = NULL;
+char **path_dirs = NULL;
+struct timespec *path_mtimes = NULL;
+int path_ndirs = 0;
+
+/* Postęp cp --progress, wspólny dla wszystkich wątków kopiujących */
+struct cp_progress
+{
+    int active;
+    off_t done;
+    off_t total;
+    struct timespec start;
+};
+
+struct cp_progress cp_prog;
+volatile sig_atomic_t progress_tick = 0;
+volatile sig_atomic_t interrupted = 0;
+
+uint32_t crc32c_table[256];
+pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+int crc32c_hw_ok = 0;
+
+__thread char *cp_buffer = NULL;
+__thread size_t cp_buffer_size = 0;
+
+const char *cp_method_names[] = { "none", "copy_file_range", "sendfile", "read/write", "reflink", "io_uring", "splice", "splice/tee" };
+
+/* Opcje polecenia cp */
+struct cp_opts
+{
+    int verbose;
+    int reflink;
+    int recursive;
+    int direct;
+    int update;
+    int checksum;
+    int verify;
+    int progress;
+    int resume;
+    size_t chunk;
+};
+
+/* Stan kopiowania jednego pliku */
+struct cp_file
+{
+    int src_fd;
+    int dst_fd;
+    int method;
+    int direct;
+    int verify;
+    uint32_t crc;
+    size_t chunk;
+    struct cp_opts *opts;
+};
+
+/* Pierścień io_uring obsługiwany bezpośrednio przez wywołania systemowe */
+struct uring
+{
+    int fd;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ptr, *cq_ptr;
+    size_t sq_len, cq_len, sqes_len;
+    unsigned to_submit;
+};
+
+/* Stan jednego bufora w potoku io_uring */
+struct uring_slot
+{
+    off_t off;
+    size_t len;
+    size_t filled;
+    size_t written;
+    int writing;
+};
+
+/* Zadanie kopiowania jednego pliku w cp -r */
+struct cp_job
+{
+    char *src;
+    char *dst;
+};
+
+/* Katalog utworzony w cp -r z tymczasowo poszerzonymi prawami (przywracane na końcu) */
+struct cp_dir
+{
+    char *path;
+    mode_t mode;
+};
+
+/* Kolejka wątku: właściciel bierze z końca, złodzieje z początku */
+struct cp_deque
+{
+    pthread_mutex_t lock;
+    struct cp_job *jobs;
+    size_t head;
+    size_t tail;
+    size_t cap;
+};
+
+/* Pula wątków z kradzieżą pracy */
+struct cp_pool
+{
+    struct cp_deque queues[CP_POOL_MAX];
+    pthread_t threads[CP_POOL_MAX];
+    int nthreads;
+    int next;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    long pending;
+    int walking;
+    int errors;
+    struct cp_opts *opts;
+    struct cp_dir *dirs;
+    int ndirs;
+    int dirs_cap;
+    mode_t umask;
+};
+
+/* Argument startowy wątku roboczego */
+struct cp_worker
+{
+    struct cp_pool *pool;
+    int id;
+};
+
+/* Nagłówek bloku zaokrąglony tak, by dane zaczynały się wyrównane */
+#define ARENA_HEADER ((sizeof(struct arena_block) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+#define ARENA_ROUND(n) (((n) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+/* Przydział z areny; brak pamięci kończy powłokę (jak xmalloc w innych powłokach) */
+void *arena_alloc(struct arena *a, size_t size)
+{
+    struct arena_block *b = a->head;
+    size_t block_size;
+    char *p;
+
+    size = ARENA_ROUND(size);
+    if (b == NULL || b->size - b->used < size)
+    {
+        block_size = b == NULL ? ARENA_BLOCK_MIN : b->size * 2;
+        while (block_size < size) block_size *= 2;
+        b = malloc(ARENA_HEADER + block_size);
+        if (b == NULL)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+        b->next = a->head;
+        b->size = block_size;
+        b->used = 0;
+        a->head = b;
+    }
+    p = (char *)b + ARENA_HEADER + b->used;
+    b->used += size;
+    return p;
+}
+
+/* Powiększenie przydziału: w miejscu, jeśli był ostatni w bloku i jest miejsce,
+   inaczej nowy przydział i kopia */
+void *arena_extend(struct arena *a, void *ptr, size_t old_size, size_t new_size)
+{
+    struct arena_block *b = a->head;
+    size_t old_round = ARENA_ROUND(old_size), new_round = ARENA_ROUND(new_size);
+    void *p;
+
+    if (b != NULL && (char *)ptr + old_round == (char *)b + ARENA_HEADER + b->used &&
+        b->size - b->used >= new_round - old_round)
+    {
+        b->used += new_round - old_round;
+        return ptr;
+    }
+    p = arena_alloc(a, new_size);
+    memcpy(p, ptr, old_size);
+    return p;
+}
+
+/* Zwolnienie wszystkiego po poleceniu; zostaje największy (najnowszy) blok */
+void arena_reset(struct arena *a)
+{
+    struct arena_block *b;
+
+    if (a->head == NULL) return;
+    while ((b = a->head->next) != NULL)
+    {
+        a->head->next = b->next;
+        free(b);
+    }
+    a->head->used = 0;
+}
+
+/* Zwolnienie wszystkich bloków areny */
+void arena_free(struct arena *a)
+{
+    struct arena_block *b;
+
+    while ((b = a->head) != NULL)
+    {
+        a->head = b->next;
+        free(b);
+    }
+}
+
 /* Funkcja dodania do historii */
 void add_to_history(char *cmd)
 {
-    int i;
+    char *copy;
+
     if (strlen(cmd) == 0) return;
-    if (history_count < HISTORY_MAX)
+    copy = strdup(cmd);
+    if (copy == NULL) return;
+    if (history_count == HISTORY_MAX)
     {
-        strcpy(history_list[history_count], cmd);
-        history_count++;
+        free(history_list[0]);
+        memmove(history_list, history_list + 1, (HISTORY_MAX - 1) * sizeof(history_list[0]));
+        history_count--;
     }
-    else
+    history_list[history_count++] = copy;
+}
+
+/* Wczytanie całej linii do areny (bufor podwajany); NULL przy EOF lub przerwaniu.
+   Linia dłuższa niż limit (ARG_MAX) jest odrzucana w całości */
+char *read_line(struct arena *a, size_t limit)
+{
+    size_t cap = ARENA_BLOCK_MIN, len = 0;
+    char *line = arena_alloc(a, cap);
+    int c;
+
+    for (;;)
     {
-        for (i = 1; i < HISTORY_MAX; i++)
+        if (fgets(line + len, cap - len, stdin) == NULL)
         {
-            strcpy(history_list[i - 1], history_list[i]);
+            if (len == 0) return NULL;
+            break;
+        }
+        len += strlen(line + len);
+        if (len > 0 && line[len - 1] == '\n') break;
+        if (len + 1 < cap) continue;
+        if (cap >= limit)
+        {
+            while ((c = getchar()) != '\n' && c != EOF);
+            fprintf(stderr, "line too long (limit %lu bytes)\n", (unsigned long)limit);
+            line[0] = '\0';
+            return line;
         }
-        strcpy(history_list[HISTORY_MAX - 1], cmd);
+        line = arena_extend(a, line, cap, cap * 2);
+        cap *= 2;
     }
+    line[strcspn(line, "\n")] = '\0';
+    return line;
 }
 
 /* Wyświetlenie znaku zachęty oraz bieżącej żcieżki roboczej */
@@ -71,42 +511,371 @@ void type_prompt()
     }
 }   
 
-/* Funkcja dzielenia wpisanego ciągu na argumenty, obsługa cydzysłowów */
-int parse_command(char *input, char **args)
+/* Rozpoznanie operatora przekierowania na początku p (poza cudzysłowem);
+   zwraca token operatora i jego długość w *len, NULL dla zwykłego znaku */
+const char *parse_operator(const char *p, int *len)
+{
+    const char *op = NULL;
+
+    if (strncmp(p, op_err_out, 4) == 0) op = op_err_out;
+    else if (strncmp(p, op_and, 2) == 0) op = op_and;
+    else if (strncmp(p, op_or, 2) == 0) op = op_or;
+    else if (strncmp(p, op_append, 2) == 0) op = op_append;
+    else if (strncmp(p, op_out_err, 2) == 0) op = op_out_err;
+    else if (strncmp(p, op_err, 2) == 0) op = op_err;
+    else if (*p == '>') op = op_out;
+    else if (*p == '<') op = op_in;
+    else if (*p == '|') op = op_pipe;
+    else if (*p == '&') op = op_bg;
+    else if (*p == ';') op = op_seq;
+    if (op != NULL) *len = (int)strlen(op);
+    return op;
+}
+
+/* Odstęp dla parsera: spacja i \t..\r, bez isspace() (zależnego od locale) */
+int parse_space(unsigned char c)
+{
+    return c == ' ' || (unsigned char)(c - '\t') < 5;
+}
+
+/* Czy znak przerywa zwykły fragment słowa: odstęp, cudzysłów, \, znak operatora albo $ */
+int parse_special(unsigned char c)
+{
+    return parse_space(c) || c == '\'' || c == '"' || c == '\\' ||
+           c == '|' || c == '&' || c == '<' || c == '>' || c == ';' || c == '$';
+}
+
+/* Pierwszy znak specjalny w [p, end) albo end; wersja bajt po bajcie */
+const char *scan_special_sw(const char *p, const char *end)
+{
+    while (p < end && !parse_special(*p)) p++;
+    return p;
+}
+
+#if defined(__x86_64__)
+/* Wersja SSE2 (zawsze dostępne na x86-64): klasyfikacja 16 bajtów na krok,
+   \t..\r przez porównanie bez znaku (x - '\t' <= 4) */
+const char *scan_special_sse2(const char *p, const char *end)
+{
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i four = _mm_set1_epi8(4);
+    __m128i x, t, m;
+    int mask;
+
+    for (; end - p >= 16; p += 16)
+    {
+        x = _mm_loadu_si128((const __m128i *)p);
+        t = _mm_sub_epi8(x, tab);
+        m = _mm_cmpeq_epi8(_mm_min_epu8(t, four), t);
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(x, _mm_set1_epi8(' ')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(x, _mm_set1_epi8('\'')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(x, _mm_set1_epi8('"')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(x, _mm_set1_epi8('\\')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(x, _mm_set1_epi8('|')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(x, _mm_set1_epi8('&')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(x, _mm_set1_epi8('<')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(x, _mm_set1_epi8('>')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(x, _mm_set1_epi8(';')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(x, _mm_set1_epi8('$')));
+        mask = _mm_movemask_epi8(m);
+        if (mask != 0) return p + __builtin_ctz(mask);
+    }
+    return scan_special_sw(p, end);
+}
+
+/* Wersja AVX2: te same porównania, 32 bajty na krok */
+__attribute__((target("avx2")))
+const char *scan_special_avx2(const char *p, const char *end)
+{
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i four = _mm256_set1_epi8(4);
+    __m256i x, t, m;
+    unsigned int mask;
+
+    for (; end - p >= 32; p += 32)
+    {
+        x = _mm256_loadu_si256((const __m256i *)p);
+        t = _mm256_sub_epi8(x, tab);
+        m = _mm256_cmpeq_epi8(_mm256_min_epu8(t, four), t);
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\'')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('"')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\\')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('|')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('&')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('<')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('>')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, _mm256_set1_epi8(';')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('$')));
+        mask = (unsigned int)_mm256_movemask_epi8(m);
+        if (mask != 0) return p + __builtin_ctz(mask);
+    }
+    return scan_special_sse2(p, end);
+}
+#endif
+
+/* Wyszukanie końca zwykłego fragmentu słowa: AVX2, jeśli procesor je ma, inaczej SSE2,
+   poza x86-64 bajt po bajcie */
+const char *scan_special(const char *p, const char *end)
+{
+#if defined(__x86_64__)
+    static int avx2_ok = -1;
+
+    if (avx2_ok == -1)
+    {
+        __builtin_cpu_init();
+        avx2_ok = __builtin_cpu_supports("avx2");
+    }
+    return avx2_ok ? scan_special_avx2(p, end) : scan_special_sse2(p, end);
+#else
+    return scan_special_sw(p, end);
+#endif
+}
+
+/* Dopisanie znacznika $? słowa word na pozycji offset; lista rośnie w arenie a
+   (cap - bieżąca pojemność) */
+void param_mark_add(struct param_marks *m, int *cap, struct arena *a, const char *word, size_t offset)
+{
+    if (m->count == *cap)
+    {
+        if (*cap == 0) m->list = arena_alloc(a, 4 * sizeof(*m->list));
+        else m->list = arena_extend(a, m->list, *cap * sizeof(*m->list), 2 * *cap * sizeof(*m->list));
+        *cap = *cap == 0 ? 4 : 2 * *cap;
+    }
+    m->list[m->count].word = word;
+    m->list[m->count++].offset = offset;
+}
+
+/* Funkcja dzielenia wpisanego ciągu na argumenty w jednym przebiegu: cudzysłowy '...'
+   i "...", znaki ucieczki \, operatory jako osobne tokeny. Słowa są rozpakowywane
+   w miejscu (zapis w nigdy nie wyprzedza odczytu p), więc koszt jest liniowy;
+   zwykłe fragmenty słów są przeskakiwane wektorowo (scan_special). Tablica argumentów
+   (zakończona NULL) rośnie w arenie a bez limitu liczby słów; miejsca $? trafiają
+   do params */
+char **parse_command(char *input, struct arena *a, struct param_marks *params)
 {
-    int j = 0;
-    int in_quotes = 0;
+    char **args;
+    int j = 0, cap = ARGS_INITIAL;
+    int len;
+    char quote = 0;
     char *p = input;
+    char *w = input;
+    char *end = input + strlen(input);
     char *arg_start = NULL;
+    char *q;
+    const char *op;
+    int params_cap = 0;
 
+    params->count = 0;
+    params->list = NULL;
+    args = arena_alloc(a, cap * sizeof(*args));
     while (*p)
     {
-        if (*p == '"')
+        /* Miejsce na dwa kolejne tokeny (słowo i operator) oraz NULL */
+        if (j + 3 > cap)
+        {
+            args = arena_extend(a, args, cap * sizeof(*args), 2 * cap * sizeof(*args));
+            cap *= 2;
+        }
+        /* '...': wszystko dosłownie do zamykającego ' */
+        if (quote == '\'')
+        {
+            q = memchr(p, '\'', end - p);
+            if (q == NULL) q = end;
+            if (w != p) memmove(w, p, q - p);
+            w += q - p;
+            p = q;
+            if (*p == '\'')
+            {
+                quote = 0;
+                p++;
+            }
+            continue;
+        }
+        /* "...": \ działa tylko przed " \ $ `, $? jest rozwijane */
+        if (quote == '"')
+        {
+            if (*p == '"') quote = 0;
+            else if (*p == '$' && p[1] == '?')
+            {
+                param_mark_add(params, &params_cap, a, arg_start, w - arg_start);
+                p++;
+            }
+            else
+            {
+                if (*p == '\\' && p[1] != '\0' && strchr("\"\\$`", p[1]) != NULL) p++;
+                *w++ = *p;
+            }
+            p++;
+            continue;
+        }
+        if (*p == '\'' || *p == '"')
+        {
+            quote = *p++;
+            if (arg_start == NULL) arg_start = w;
+            continue;
+        }
+        if (*p == '\\' && p[1] != '\0')
+        {
+            if (arg_start == NULL) arg_start = w;
+            *w++ = p[1];
+            p += 2;
+            continue;
+        }
+        if (*p == '$' && p[1] == '?')
         {
-            in_quotes = !in_quotes;
-            memmove(p, p + 1, strlen(p));
-            if (arg_start == NULL) arg_start = p;
+            if (arg_start == NULL) arg_start = w;
+            param_mark_add(params, &params_cap, a, arg_start, w - arg_start);
+            p += 2;
             continue;
         }
-        if (!in_quotes && isspace(*p))
+        /* "2>" jest operatorem tylko na początku słowa (a2>b to słowo i przekierowanie >) */
+        op = *p == '2' && arg_start != NULL ? NULL : parse_operator(p, &len);
+        if (parse_space(*p) || op != NULL)
         {
-            if(arg_start != NULL)
+            /* Terminator słowa może nadpisać już rozpoznany operator (w <= p) */
+            if (arg_start != NULL)
             {
-                *p = '\0';
-                if (j < MAX_ARGS - 1) args[j++] = arg_start;
+                *w++ = '\0';
+                args[j++] = arg_start;
                 arg_start = NULL;
             }
+            if (op != NULL) args[j++] = (char *)op;
+            p += op != NULL ? len : 1;
+            continue;
         }
-        else if (arg_start == NULL) arg_start = p;
-        p++;
+        if (arg_start == NULL) arg_start = w;
+        q = (char *)scan_special(p + 1, end);
+        if (w != p) memmove(w, p, q - p);
+        w += q - p;
+        p = q;
+    }
+    if (arg_start != NULL)
+    {
+        *w = '\0';
+        args[j++] = arg_start;
     }
-    if (arg_start != NULL && j < MAX_ARGS - 1) args[j++] = arg_start;
     args[j] = NULL;
-    return j;
+    return args;
+}
+
+/* Czy token jest operatorem przekierowania */
+int is_redirect_op(const char *tok)
+{
+    return tok == op_in || tok == op_out || tok == op_append || tok == op_err ||
+           tok == op_err_out || tok == op_out_err;
+}
+
+/* Czy token jest operatorem listy poleceń (; && || &) */
+int is_list_op(const char *tok)
+{
+    return tok == op_seq || tok == op_and || tok == op_or || tok == op_bg;
+}
+
+/* Wydzielenie przekierowań z argumentów polecenia (args jest zagęszczane);
+   0 - poprawnie, -1 - błąd składni */
+int collect_redirects(char **args, struct redirects *r)
+{
+    const char *op;
+    struct redirect *rd;
+    int i, j = 0;
+
+    r->count = 0;
+    for (i = 0; args[i] != NULL; i++)
+    {
+        op = args[i];
+        if (!is_redirect_op(op))
+        {
+            args[j++] = args[i];
+            continue;
+        }
+        if (r->count + 2 > MAX_REDIRS)
+        {
+            fprintf(stderr, "too many redirections\n");
+            return -1;
+        }
+        rd = &r->list[r->count++];
+        rd->path = NULL;
+        rd->flags = 0;
+        rd->dup_fd = -1;
+        if (op == op_err_out)
+        {
+            rd->fd = STDERR_FILENO;
+            rd->dup_fd = STDOUT_FILENO;
+            continue;
+        }
+        if (args[i + 1] == NULL || args[i + 1] == op_pipe || is_list_op(args[i + 1]) || is_redirect_op(args[i + 1]))
+        {
+            fprintf(stderr, "syntax error near unexpected token '%s'\n", args[i + 1] != NULL ? args[i + 1] : "newline");
+            return -1;
+        }
+        rd->path = args[++i];
+        rd->fd = op == op_in ? STDIN_FILENO : op == op_err ? STDERR_FILENO : STDOUT_FILENO;
+        rd->flags = op == op_in ? O_RDONLY :
+                    op == op_append ? O_WRONLY | O_CREAT | O_APPEND : O_WRONLY | O_CREAT | O_TRUNC;
+        /* &> plik: stdout do pliku, stderr jako jego kopia */
+        if (op == op_out_err)
+        {
+            rd = &r->list[r->count++];
+            rd->fd = STDERR_FILENO;
+            rd->path = NULL;
+            rd->flags = 0;
+            rd->dup_fd = STDOUT_FILENO;
+        }
+    }
+    args[j] = NULL;
+    return 0;
+}
+
+/* Przywrócenie deskryptorów zapisanych przez apply_redirects() (w odwrotnej kolejności) */
+void restore_redirects(const struct redirects *r, int *saved, int count)
+{
+    int i;
+
+    for (i = count - 1; i >= 0; i--)
+    {
+        if (saved[i] != -1)
+        {
+            dup2(saved[i], r->list[i].fd);
+            close(saved[i]);
+        }
+        else close(r->list[i].fd);
+    }
+}
+
+/* Zastosowanie przekierowań w bieżącym procesie; saved (może być NULL) dostaje
+   kopie zastąpionych deskryptorów do późniejszego restore_redirects() */
+int apply_redirects(const struct redirects *r, int *saved)
+{
+    const struct redirect *rd;
+    int i, fd;
+
+    for (i = 0; i < r->count; i++)
+    {
+        rd = &r->list[i];
+        if (saved != NULL) saved[i] = fcntl(rd->fd, F_DUPFD_CLOEXEC, 10);
+        if (rd->path == NULL)
+        {
+            fd = rd->dup_fd;
+        }
+        else
+        {
+            fd = open(rd->path, rd->flags | O_CLOEXEC, 0666);
+            if (fd == -1)
+            {
+                fprintf(stderr, "%s: %s\n", rd->path, strerror(errno));
+                if (saved != NULL) restore_redirects(r, saved, i + 1);
+                return -1;
+            }
+        }
+        if (fd != rd->fd) dup2(fd, rd->fd);
+        if (rd->path != NULL && fd != rd->fd) close(fd);
+    }
+    return 0;
 }
 
 /* Funkcja cd: -, ~, errors */
-void builtin_cd(char **args)
+int builtin_cd(char **args)
 {
     char *target_path;
     static char prev_dir[PATH_MAX_LEN] = "";
@@ -116,7 +885,7 @@ void builtin_cd(char **args)
     if (getcwd(current_dir, sizeof(current_dir)) == NULL)
     {
         perror("cd: getcwd error");
-        return;
+        return 1;
     }
 
     if (args[1] == NULL)
@@ -125,7 +894,7 @@ void builtin_cd(char **args)
         if (target_path == NULL)
         {
             fprintf(stderr, "cd: HOME variable not set\n");
-            return;
+            return 1;
         }
     }
     else if (strcmp(args[1], "-") == 0)
@@ -133,7 +902,7 @@ void builtin_cd(char **args)
         if (strlen(prev_dir) == 0)
         {
             fprintf(stderr, "cd: OLDPWD not set\n");
-            return;
+            return 1;
         }
         target_path = prev_dir;
         printf("%s\n", target_path);
@@ -144,56 +913,63 @@ void builtin_cd(char **args)
         if (home == NULL)
         {
             fprintf(stderr, "cd: HOME variable not set\n");
-            return;
+            return 1;
         }
         snprintf(home_path, sizeof(home_path), "%s%s", home, args[1] + 1);
         target_path = home_path;
     }
     else target_path = args[1];
     
-    if (chdir(target_path) != 0) perror("cd");
-    else strcpy(prev_dir, current_dir);
+    if (chdir(target_path) != 0)
+    {
+        perror("cd");
+        return 1;
+    }
+    strcpy(prev_dir, current_dir);
+    return 0;
 }
 
 /* Funkcja touch */
-void builtin_touch(char **args)
+int builtin_touch(char **args)
 {
     int fd;
 
     if (args[1] == NULL) {
         fprintf(stderr, "touch: missing file operand\n");
-        return;
+        return 1;
     }
 
     fd = open(args[1], O_WRONLY | O_CREAT, 0644);
 
     if (fd == -1) {
         perror("touch");
-        return;
+        return 1;
     }
 
     close(fd);
 
     if (utime(args[1], NULL) == -1) {
         perror("touch: utime error");
+        return 1;
     }
+    return 0;
 }
 
 /* Funckja stat */
-void builtin_stat(char **args)
+int builtin_stat(char **args)
 {
     struct stat file_stat;
 
     if (args[1] == NULL)
     {
         fprintf(stderr, "stat: missing file operand\n");
-        return;
+        return 1;
     }
 
     if (stat(args[1], &file_stat) == -1)
     {
         perror("stat");
-        return;
+        return 1;
     }
 
     printf(" File: %s\n", args[1]);
@@ -203,150 +979,3280 @@ void builtin_stat(char **args)
     printf(" Access: (%04o)\n", file_stat.st_mode & 0777);
     printf(" Uid: %d    Gid: %d\n", file_stat.st_uid, file_stat.st_gid);
     printf(" Modify: %s", ctime(&file_stat.st_mtime));
+    return 0;
 }
 
 /* Funkcja history */
-void builtin_history()
+int builtin_history(char **args)
 {
     int i;
+    (void)args;
     for (i = 0; i < history_count; i++)
     {
         printf("%s\n", history_list[i]);
     }
+    return 0;
 }
 
-/* Funckja help */
-void builtin_help()
+/* Funckja help: treść budowana z tabeli poleceń wbudowanych */
+int builtin_help(char **args)
 {
+    static const char *headers[] = { "",
+        "1) Wbudowany komendy:",
+        "2) Dodatkowe bajery: login, kolory, CTRL+C, cudzysłów",
+        "3) Własne komendy:" };
+    size_t i;
+    int group;
+    (void)args;
+
     printf("\n--- Microshell by Yaroslav Zamorskyi ---\n");
-    printf("1) Wbudowany komendy:\n");
-    printf("  - cd [path] - zmienić katalog\n");
-    printf("  - exit - wyjść z programu\n");
-    printf("  - help - wyświetlić ten komunikat\n");
-    printf("2) Dodatkowe bajery: login, kolory, CTRL+C, cudzysłów, clear, history\n");
-    printf("3) Własne komendy: cp, touch, stat\n\n");
+    for (group = BI_GROUP_CORE; group <= BI_GROUP_OWN; group++)
+    {
+        printf("%s\n", headers[group]);
+        for (i = 0; i < builtin_count; i++)
+        {
+            if (builtins[i].group == group) printf("  - %s - %s\n", builtins[i].usage, builtins[i].description);
+        }
+    }
+    printf("\n");
+    return 0;
 }
 
 /* Funckja clear */
-void builtin_clear()
+int builtin_clear(char **args)
 {
-    printf("%s", C_CLEAR);  
+    (void)args;
+    printf("%s", C_CLEAR);
+    return 0;
 }
 
-/* Funkcja cp */
-void builtin_cp(char **args)
+/* SIGALRM: tylko znacznik, wypisywaniem zajmuje się kopiujący wątek */
+void progress_alarm_handler(int signum)
 {
-    int src_fd, dst_fd;
-    ssize_t n_read;
-    char buffer[FILE_BUF_SIZE];
-    struct stat src_stat, dst_stat;
+    (void)signum;
+    progress_tick = 1;
+}
 
-    if (args[1] == NULL || args[2] == NULL)
-    {
-        fprintf(stderr, "cp: missing file operand\n");
-        return;
-    }
+/* Sekundy od początku kopiowania */
+double cp_elapsed()
+{
+    struct timespec now;
 
-    if (stat(args[1], &src_stat) == -1)
-    {
-        perror("cp: stat error");
-        return;
-    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - cp_prog.start.tv_sec) + (now.tv_nsec - cp_prog.start.tv_nsec) / 1e9;
+}
 
-    if (stat(args[2], &dst_stat) == 0)
-    {
-        if (src_stat.st_dev == dst_stat.st_dev && src_stat.st_ino == dst_stat.st_ino)
-        {
-            fprintf(stderr, "cp: '%s' and '%s' are the same file\n", args[1], args[2]);
-            return;
-        }
-    }
+/* Linia stanu: skopiowane bajty, MB/s i ETA */
+void cp_progress_print()
+{
+    off_t done = __atomic_load_n(&cp_prog.done, __ATOMIC_RELAXED);
+    off_t total = __atomic_load_n(&cp_prog.total, __ATOMIC_RELAXED);
+    double elapsed = cp_elapsed();
+    double rate = elapsed > 0 ? done / elapsed : 0;
+    long eta = (rate > 0 && total > done) ? (long)((total - done) / rate) : 0;
 
-    src_fd = open(args[1], O_RDONLY);
-    if (src_fd == -1)
+    fprintf(stderr, "\r\033[K%.1f / %.1f MB (%d%%), %.1f MB/s, ETA %ld:%02ld",
+            done / 1048576.0, total / 1048576.0, total > 0 ? (int)(done * 100 / total) : 100,
+            rate / 1048576.0, eta / 60, eta % 60);
+}
+
+/* Zliczenie skopiowanych bajtów; linia stanu odświeżana z zegara, nie co kawałek */
+void cp_progress_add(off_t n)
+{
+    if (!cp_prog.active) return;
+    __atomic_add_fetch(&cp_prog.done, n, __ATOMIC_RELAXED);
+    if (progress_tick && __atomic_exchange_n(&progress_tick, 0, __ATOMIC_RELAXED)) cp_progress_print();
+}
+
+/* Start pomiaru i zegara odświeżania */
+void cp_progress_begin(off_t total)
+{
+    struct sigaction sa;
+    struct itimerval timer;
+
+    cp_prog.active = 1;
+    cp_prog.done = 0;
+    cp_prog.total = total;
+    clock_gettime(CLOCK_MONOTONIC, &cp_prog.start);
+
+    sa.sa_handler = progress_alarm_handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGALRM, &sa, NULL);
+
+    timer.it_interval.tv_sec = 0;
+    timer.it_interval.tv_usec = PROGRESS_INTERVAL_US;
+    timer.it_value = timer.it_interval;
+    setitimer(ITIMER_REAL, &timer, NULL);
+}
+
+/* Zatrzymanie zegara i podsumowanie do parsowania */
+void cp_progress_end()
+{
+    struct itimerval timer;
+    double elapsed = cp_elapsed();
+
+    memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_REAL, &timer, NULL);
+    signal(SIGALRM, SIG_DFL);
+    progress_tick = 0;
+
+    cp_progress_print();
+    fprintf(stderr, "\n");
+    printf("cp: copied %ld bytes in %.3f s (%.1f MB/s)\n", (long)cp_prog.done, elapsed,
+           elapsed > 0 ? cp_prog.done / elapsed / 1048576.0 : 0.0);
+    cp_prog.active = 0;
+}
+
+/* Zwolnienie bufora kopiowania bieżącego wątku */
+void cp_release_buffer()
+{
+    if (cp_buffer != NULL) munmap(cp_buffer, cp_buffer_size);
+    cp_buffer = NULL;
+    cp_buffer_size = 0;
+}
+
+/* Bufor kopiowania wielokrotnego użytku (na wątek), duże na stronach hugepage */
+char *cp_get_buffer(size_t size)
+{
+    void *p = MAP_FAILED;
+
+    if (cp_buffer_size >= size) return cp_buffer;
+    cp_release_buffer();
+
+    if (size % HUGE_PAGE_SIZE == 0)
+    {
+        p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    }
+    if (p == MAP_FAILED)
+    {
+        p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) return NULL;
+        if (size >= HUGE_PAGE_SIZE) madvise(p, size, MADV_HUGEPAGE);
+    }
+    cp_buffer = p;
+    cp_buffer_size = size;
+    return cp_buffer;
+}
+
+/* Rozmiar kawałka: wielokrotność st_blksize obu plików, rośnie z rozmiarem pliku do CP_BUF_MAX */
+size_t cp_pick_chunk(struct stat *src_stat, struct stat *dst_stat, off_t len)
+{
+    size_t blk = src_stat->st_blksize > dst_stat->st_blksize ? src_stat->st_blksize : dst_stat->st_blksize;
+    size_t chunk = FILE_BUF_SIZE;
+
+    if (blk < 512) blk = 512;
+    while (len > 0 && chunk < CP_BUF_MAX && (off_t)chunk * 16 < len) chunk *= 2;
+    return (chunk + blk - 1) / blk * blk;
+}
+
+/* Rozmiar pojedynczego wywołania kopiującego w jądrze */
+size_t cp_chunk(off_t left)
+{
+    return left > CP_CHUNK_MAX ? CP_CHUNK_MAX : (size_t)left;
+}
+
+/* Czy błąd oznacza brak obsługi danej metody (przejście do następnej) */
+int cp_unsupported(int err)
+{
+    return err == ENOSYS || err == EXDEV || err == EINVAL || err == EOPNOTSUPP || err == ETXTBSY;
+}
+
+/* CTRL+C w trakcie kopiowania: przerwanie pętli (dziennik --resume zostaje); komunikat
+   wypisuje raz builtin_cp */
+int cp_interrupted()
+{
+    return interrupted != 0;
+}
+
+/* Kopiowanie w jądrze: copy_file_range(); 0 - gotowe, 1 - nieobsługiwane, -1 - błąd */
+int cp_by_copy_file_range(struct cp_file *f, off_t *off, off_t *left)
+{
+    off_t in_off = *off, out_off = *off;
+    off_t start = *off;
+    ssize_t n;
+
+    while (*left > 0)
+    {
+        if (cp_interrupted()) return -1;
+        n = copy_file_range(f->src_fd, &in_off, f->dst_fd, &out_off, cp_chunk(*left), 0);
+        if (n == -1)
+        {
+            if (cp_unsupported(errno)) return 1;
+            perror("cp: copy_file_range error");
+            return -1;
+        }
+        if (n == 0) return *off == start ? 1 : 0;
+        cp_progress_add(n);
+        *off += n;
+        *left -= n;
+    }
+    return 0;
+}
+
+/* Kopiowanie w jądrze: sendfile(); 0 - gotowe, 1 - nieobsługiwane, -1 - błąd */
+int cp_by_sendfile(struct cp_file *f, off_t *off, off_t *left)
+{
+    off_t in_off = *off;
+    off_t start = *off;
+    ssize_t n;
+
+    lseek(f->dst_fd, *off, SEEK_SET);
+    while (*left > 0)
+    {
+        if (cp_interrupted()) return -1;
+        n = sendfile(f->dst_fd, f->src_fd, &in_off, cp_chunk(*left));
+        if (n == -1)
+        {
+            if (cp_unsupported(errno)) return 1;
+            perror("cp: sendfile error");
+            return -1;
+        }
+        if (n == 0) return *off == start ? 1 : 0;
+        cp_progress_add(n);
+        *off += n;
+        *left -= n;
+    }
+    return 0;
+}
+
+/* Utworzenie pierścienia io_uring i zmapowanie kolejek */
+int uring_init(struct uring *r, unsigned entries)
+{
+    struct io_uring_params p;
+    int single;
+
+    memset(&p, 0, sizeof(p));
+    memset(r, 0, sizeof(*r));
+    r->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (r->fd < 0) return -1;
+
+    single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    r->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (single && r->cq_len > r->sq_len) r->sq_len = r->cq_len;
+    r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    r->sq_ptr = mmap(NULL, r->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_ptr == MAP_FAILED)
+    {
+        close(r->fd);
+        return -1;
+    }
+    r->cq_ptr = single ? r->sq_ptr : mmap(NULL, r->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+    r->sqes = mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->cq_ptr == MAP_FAILED || r->sqes == MAP_FAILED)
+    {
+        if (r->cq_ptr != MAP_FAILED && !single) munmap(r->cq_ptr, r->cq_len);
+        if (r->sqes != MAP_FAILED) munmap(r->sqes, r->sqes_len);
+        munmap(r->sq_ptr, r->sq_len);
+        close(r->fd);
+        return -1;
+    }
+    if (single) r->cq_len = 0;
+
+    r->sq_head = (unsigned *)((char *)r->sq_ptr + p.sq_off.head);
+    r->sq_tail = (unsigned *)((char *)r->sq_ptr + p.sq_off.tail);
+    r->sq_mask = (unsigned *)((char *)r->sq_ptr + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *)((char *)r->sq_ptr + p.sq_off.array);
+    r->cq_head = (unsigned *)((char *)r->cq_ptr + p.cq_off.head);
+    r->cq_tail = (unsigned *)((char *)r->cq_ptr + p.cq_off.tail);
+    r->cq_mask = (unsigned *)((char *)r->cq_ptr + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)((char *)r->cq_ptr + p.cq_off.cqes);
+    return 0;
+}
+
+/* Zwolnienie pierścienia io_uring */
+void uring_free(struct uring *r)
+{
+    munmap(r->sqes, r->sqes_len);
+    if (r->cq_len > 0) munmap(r->cq_ptr, r->cq_len);
+    munmap(r->sq_ptr, r->sq_len);
+    close(r->fd);
+}
+
+/* Dodanie operacji na zarejestrowanym buforze do kolejki zgłoszeń */
+void uring_prep(struct uring *r, int opcode, int fd, int slot, char *buf, size_t len, off_t off)
+{
+    unsigned tail = *r->sq_tail;
+    unsigned idx = tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[idx];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long)buf;
+    sqe->len = len;
+    sqe->off = off;
+    sqe->buf_index = slot;
+    sqe->user_data = slot;
+    r->sq_array[idx] = idx;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    r->to_submit++;
+}
+
+/* Potok io_uring: odczyt kawałka N+1 nakłada się na zapis kawałka N (tylko duże pliki) */
+int cp_by_io_uring(struct cp_file *f, off_t *off, off_t *left)
+{
+    struct uring r;
+    struct uring_slot slots[URING_DEPTH];
+    struct iovec iov[URING_DEPTH];
+    struct io_uring_cqe *cqe;
+    struct uring_slot *sl;
+    struct stat dst_stat;
+    char *bufs;
+    size_t slot_size = f->chunk < URING_BUF_SIZE ? f->chunk : URING_BUF_SIZE;
+    off_t next = *off;
+    off_t end = *off + *left;
+    off_t copied = 0;
+    unsigned head, tail;
+    int i, inflight = 0, rc = 0;
+    long ret;
+
+    if (*left < URING_MIN_SIZE || fstat(f->dst_fd, &dst_stat) == -1 || !S_ISREG(dst_stat.st_mode)) return 1;
+    bufs = cp_get_buffer(URING_DEPTH * slot_size);
+    if (bufs == NULL || uring_init(&r, URING_DEPTH) == -1) return 1;
+    for (i = 0; i < URING_DEPTH; i++)
+    {
+        iov[i].iov_base = bufs + (size_t)i * slot_size;
+        iov[i].iov_len = slot_size;
+    }
+    if (syscall(__NR_io_uring_register, r.fd, IORING_REGISTER_BUFFERS, iov, URING_DEPTH) < 0)
+    {
+        uring_free(&r);
+        return 1;
+    }
+
+    for (i = 0; i < URING_DEPTH && next < end; i++)
+    {
+        sl = &slots[i];
+        sl->off = next;
+        sl->len = cp_chunk(end - next) < slot_size ? cp_chunk(end - next) : slot_size;
+        sl->writing = 0;
+        next += sl->len;
+        uring_prep(&r, IORING_OP_READ_FIXED, f->src_fd, i, iov[i].iov_base, sl->len, sl->off);
+        inflight++;
+    }
+
+    while (inflight > 0)
+    {
+        if (cp_interrupted())
+        {
+            rc = -1;
+            break;
+        }
+        ret = syscall(__NR_io_uring_enter, r.fd, r.to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (ret < 0)
+        {
+            if (errno == EINTR) continue;
+            perror("cp: io_uring_enter error");
+            rc = -1;
+            break;
+        }
+        r.to_submit -= (unsigned)ret;
+
+        head = *r.cq_head;
+        tail = __atomic_load_n(r.cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++)
+        {
+            cqe = &r.cqes[head & *r.cq_mask];
+            i = (int)cqe->user_data;
+            sl = &slots[i];
+            inflight--;
+
+            if (cqe->res < 0)
+            {
+                if (rc == 0 && copied == 0 && (cqe->res == -EINVAL || cqe->res == -EOPNOTSUPP)) rc = 1;
+                else if (rc == 0)
+                {
+                    errno = -cqe->res;
+                    perror(sl->writing ? "cp: write error" : "cp: read error");
+                    rc = -1;
+                }
+                continue;
+            }
+            if (rc != 0) continue;
+
+            if (!sl->writing)
+            {
+                /* Odczyt 0 bajtów: plik skrócił się w trakcie kopiowania */
+                if (cqe->res == 0) continue;
+                sl->filled = cqe->res;
+                sl->written = 0;
+                sl->writing = 1;
+            }
+            else
+            {
+                if (cqe->res == 0)
+                {
+                    fprintf(stderr, "cp: write error: no progress\n");
+                    rc = -1;
+                    continue;
+                }
+                sl->written += cqe->res;
+                if (sl->written == sl->filled)
+                {
+                    copied += sl->filled;
+                    cp_progress_add(sl->filled);
+                    sl->writing = 0;
+                    if (sl->filled < sl->len)
+                    {
+                        /* Krótki odczyt: doczytanie reszty kawałka */
+                        sl->off += sl->filled;
+                        sl->len -= sl->filled;
+                    }
+                    else if (next < end)
+                    {
+                        sl->off = next;
+                        sl->len = cp_chunk(end - next) < slot_size ? cp_chunk(end - next) : slot_size;
+                        next += sl->len;
+                    }
+                    else continue;
+                    uring_prep(&r, IORING_OP_READ_FIXED, f->src_fd, i, iov[i].iov_base, sl->len, sl->off);
+                    inflight++;
+                    continue;
+                }
+            }
+            uring_prep(&r, IORING_OP_WRITE_FIXED, f->dst_fd, i, (char *)iov[i].iov_base + sl->written,
+                       sl->filled - sl->written, sl->off + sl->written);
+            inflight++;
+        }
+        __atomic_store_n(r.cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    uring_free(&r);
+    if (rc == 0)
+    {
+        *off += copied;
+        *left -= copied;
+    }
+    return rc;
+}
+
+/* Tablica CRC32C (Castagnoli) i wykrycie instrukcji SSE4.2 */
+void crc32c_init()
+{
+    uint32_t c;
+    int i, k;
+
+    for (i = 0; i < 256; i++)
+    {
+        c = i;
+        for (k = 0; k < 8; k++) c = (c & 1) ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+        crc32c_table[i] = c;
+    }
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    crc32c_hw_ok = __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+/* CRC32C programowo, bajt po bajcie z tablicy */
+uint32_t crc32c_sw(uint32_t crc, const unsigned char *p, size_t n)
+{
+    while (n-- > 0) crc = crc32c_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+#if defined(__x86_64__)
+/* CRC32C sprzętowo: instrukcja crc32 z SSE4.2, 8 bajtów na krok */
+__attribute__((target("sse4.2")))
+uint32_t crc32c_hw(uint32_t crc, const unsigned char *p, size_t n)
+{
+    uint64_t c = crc;
+    uint64_t w;
+
+    for (; n > 0 && ((uintptr_t)p & 7) != 0; n--) c = __builtin_ia32_crc32qi((uint32_t)c, *p++);
+    for (; n >= 8; p += 8, n -= 8)
+    {
+        memcpy(&w, p, 8);
+        c = __builtin_ia32_crc32di(c, w);
+    }
+    for (; n > 0; n--) c = __builtin_ia32_crc32qi((uint32_t)c, *p++);
+    return (uint32_t)c;
+}
+#endif
+
+/* Aktualizacja CRC32C (stan bez odwracania bitów, początkowo i na końcu ~0) */
+uint32_t crc32c_update(uint32_t crc, const unsigned char *p, size_t n)
+{
+    pthread_once(&crc32c_once, crc32c_init);
+#if defined(__x86_64__)
+    if (crc32c_hw_ok) return crc32c_hw(crc, p, n);
+#endif
+    return crc32c_sw(crc, p, n);
+}
+
+/* CRC32C ciągu zer (dziury w plikach rzadkich) */
+uint32_t crc32c_zeros(uint32_t crc, off_t n)
+{
+    static const unsigned char zeros[4096];
+
+    for (; n > 0; n -= sizeof(zeros)) crc = crc32c_update(crc, zeros, n < (off_t)sizeof(zeros) ? (size_t)n : sizeof(zeros));
+    return crc;
+}
+
+/* CRC32C zakresu [off, off+len) deskryptora; len < 0 oznacza do EOF */
+int crc32c_range(int fd, off_t off, off_t len, size_t chunk, uint32_t *crc)
+{
+    char *buffer = cp_get_buffer(chunk);
+    ssize_t n = 0;
+
+    if (buffer == NULL) return -1;
+    *crc = 0xFFFFFFFFU;
+    while (len != 0)
+    {
+        n = pread(fd, buffer, (len < 0 || len > (off_t)chunk) ? chunk : (size_t)len, off);
+        if (n <= 0) break;
+        *crc = crc32c_update(*crc, (unsigned char *)buffer, n);
+        off += n;
+        if (len > 0) len -= n;
+    }
+    *crc = ~*crc;
+    return n == -1 ? -1 : 0;
+}
+
+/* CRC32C całej zawartości pliku odczytanej z dysku (po zrzuceniu page cache) */
+int crc32c_file(char *path, size_t chunk, uint32_t *crc)
+{
+    int fd, rc;
+
+    fd = open(path, O_RDONLY);
+    if (fd == -1) return -1;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    rc = crc32c_range(fd, 0, -1, chunk, crc);
+    close(fd);
+    return rc;
+}
+
+/* --verify: zapis na dysk, ponowny odczyt celu i porównanie z CRC strumienia */
+int cp_verify(char *dst, int dst_fd, uint32_t crc, size_t chunk)
+{
+    uint32_t dst_crc;
+
+    if (fdatasync(dst_fd) == -1 && errno != EINVAL)
+    {
+        perror("cp: fdatasync error");
+        return -1;
+    }
+    if (crc32c_file(dst, chunk, &dst_crc) == -1)
+    {
+        perror("cp: verify read error");
+        return -1;
+    }
+    if (dst_crc != crc)
+    {
+        fprintf(stderr, "cp: verification failed for '%s' (crc32c %08x, expected %08x)\n",
+                dst, (unsigned)dst_crc, (unsigned)crc);
+        return -1;
+    }
+    printf("%08x  %s (crc32c verified)\n", (unsigned)crc, dst);
+    return 0;
+}
+
+/* Wyłączenie O_DIRECT na deskryptorze; 1 jeśli był włączony */
+int drop_direct(int fd)
+{
+    int flags = fcntl(fd, F_GETFL);
+
+    if (flags == -1 || !(flags & O_DIRECT)) return 0;
+    return fcntl(fd, F_SETFL, flags & ~O_DIRECT) == 0;
+}
+
+/* Klasyczna pętla read()/write(); left < 0 oznacza kopiowanie do EOF */
+int cp_by_read_write(struct cp_file *f, off_t *off, off_t *left)
+{
+    char *buffer = cp_get_buffer(f->chunk);
+    ssize_t n_read, n_written, done;
+    size_t want;
+
+    if (buffer == NULL)
+    {
+        perror("cp: buffer allocation error");
+        return -1;
+    }
+    if (*left >= 0)
+    {
+        lseek(f->src_fd, *off, SEEK_SET);
+        lseek(f->dst_fd, *off, SEEK_SET);
+    }
+    while (*left != 0)
+    {
+        if (cp_interrupted()) return -1;
+        want = (*left < 0 || *left > (off_t)f->chunk) ? f->chunk : (size_t)*left;
+        /* O_DIRECT: długość odczytu wyrównana, krótszy odczyt przy EOF jest dozwolony */
+        if (f->direct) want = (want + DIRECT_ALIGN - 1) / DIRECT_ALIGN * DIRECT_ALIGN;
+        n_read = read(f->src_fd, buffer, want);
+        if (n_read == -1)
+        {
+            if (errno == EINVAL && drop_direct(f->src_fd)) continue;
+            perror("cp: read error");
+            return -1;
+        }
+        if (n_read == 0) break;
+        if (*left > 0 && n_read > *left) n_read = *left;
+        if (f->verify) f->crc = crc32c_update(f->crc, (unsigned char *)buffer, n_read);
+        for (done = 0; done < n_read; done += n_written)
+        {
+            /* Niewyrównany ogon zapisujemy już bez O_DIRECT */
+            if (f->direct && (n_read - done) % DIRECT_ALIGN != 0) drop_direct(f->dst_fd);
+            n_written = write(f->dst_fd, buffer + done, n_read - done);
+            if (n_written == -1)
+            {
+                if (errno == EINVAL && drop_direct(f->dst_fd))
+                {
+                    n_written = 0;
+                    continue;
+                }
+                perror("cp: write error");
+                return -1;
+            }
+        }
+        cp_progress_add(n_read);
+        *off += n_read;
+        if (*left > 0) *left -= n_read;
+    }
+    return 0;
+}
+
+/* Źródło bez znanego rozmiaru (potok, urządzenie): splice() do EOF, gdy jedna ze
+   stron jest potokiem; 0 - gotowe, 1 - nieobsługiwane, -1 - błąd */
+int cp_by_splice(struct cp_file *f, off_t *off, off_t *left)
+{
+    ssize_t n;
+    off_t start = *off;
+
+    for (;;)
+    {
+        if (cp_interrupted()) return -1;
+        n = splice(f->src_fd, NULL, f->dst_fd, NULL, f->chunk, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (n == -1)
+        {
+            if (*off == start && cp_unsupported(errno)) return 1;
+            perror("cp: splice error");
+            return -1;
+        }
+        if (n == 0) break;
+        cp_progress_add(n);
+        *off += n;
+    }
+    *left = 0;
+    return 0;
+}
+
+/* Silnik kopiowania: copy_file_range -> io_uring -> sendfile -> read/write;
+   f->method: pierwsza dozwolona metoda, po powrocie metoda użyta */
+int copy_window(struct cp_file *f, off_t off, off_t len)
+{
+    int rc = 1;
+
+    if (len > 0)
+    {
+        if (f->method == CP_COPY_FILE_RANGE)
+        {
+            rc = cp_by_copy_file_range(f, &off, &len);
+        }
+        if (rc == 1 && (f->method == CP_COPY_FILE_RANGE || f->method == CP_IO_URING))
+        {
+            f->method = CP_IO_URING;
+            rc = cp_by_io_uring(f, &off, &len);
+        }
+        if (rc == 1 && f->method != CP_READ_WRITE)
+        {
+            f->method = CP_SENDFILE;
+            rc = cp_by_sendfile(f, &off, &len);
+        }
+    }
+    else if (f->method != CP_READ_WRITE)
+    {
+        f->method = CP_SPLICE;
+        rc = cp_by_splice(f, &off, &len);
+    }
+    if (rc == 1)
+    {
+        f->method = CP_READ_WRITE;
+        rc = cp_by_read_write(f, &off, &len);
+    }
+    return rc;
+}
+
+/* Kopiowanie zakresu oknami: zapis okna N startuje w tle, okno N-1 jest
+   dopisywane na dysk i usuwane z page cache (duże kopie nie wypychają gorących danych) */
+int copy_data(struct cp_file *f, off_t off, off_t len)
+{
+    off_t win, prev_off = -1, prev_len = 0;
+
+    if (len == 0)
+    {
+        f->method = CP_NONE;
+        return 0;
+    }
+    if (len <= CP_CACHE_WINDOW) return copy_window(f, off, len);
+
+    while (len > 0)
+    {
+        win = len > CP_CACHE_WINDOW ? CP_CACHE_WINDOW : len;
+        if (copy_window(f, off, win) == -1) return -1;
+
+        sync_file_range(f->dst_fd, off, win, SYNC_FILE_RANGE_WRITE);
+        posix_fadvise(f->src_fd, off, win, POSIX_FADV_DONTNEED);
+        if (prev_off >= 0)
+        {
+            sync_file_range(f->dst_fd, prev_off, prev_len,
+                            SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+            posix_fadvise(f->dst_fd, prev_off, prev_len, POSIX_FADV_DONTNEED);
+        }
+        prev_off = off;
+        prev_len = win;
+        off += win;
+        len -= win;
+    }
+    return 0;
+}
+
+/* Kopiowanie pliku rzadkiego: tylko zakresy danych (SEEK_DATA/SEEK_HOLE), dziury zostają */
+int copy_sparse(struct cp_file *f, off_t len)
+{
+    off_t off = 0;
+    off_t data, hole;
+    int first = f->method;
+
+    while (off < len)
+    {
+        data = lseek(f->src_fd, off, SEEK_DATA);
+        if (data == -1)
+        {
+            if (errno == ENXIO) break;
+            if (off == 0) return copy_data(f, 0, len);
+            perror("cp: lseek error");
+            return -1;
+        }
+        if (data >= len) break;
+        hole = lseek(f->src_fd, data, SEEK_HOLE);
+        if (hole == -1 || hole > len) hole = len;
+        if (f->verify) f->crc = crc32c_zeros(f->crc, data - off);
+        cp_progress_add(data - off);
+
+        f->method = first;
+        if (copy_data(f, data, hole - data) == -1) return -1;
+        off = hole;
+    }
+    if (f->verify && off < len) f->crc = crc32c_zeros(f->crc, len - off);
+    if (off < len) cp_progress_add(len - off);
+
+    if (ftruncate(f->dst_fd, len) == -1)
+    {
+        perror("cp: ftruncate error");
+        return -1;
+    }
+    return 0;
+}
+
+/* Szybki 64-bitowy skrót danych (mnożenie i rotacja po słowach 8-bajtowych) */
+uint64_t hash64_update(uint64_t h, const unsigned char *p, size_t n)
+{
+    uint64_t w;
+
+    for (; n >= 8; p += 8, n -= 8)
+    {
+        memcpy(&w, p, 8);
+        h ^= w * HASH_PRIME2;
+        h = ((h << 31) | (h >> 33)) * HASH_PRIME1;
+    }
+    for (; n > 0; p++, n--)
+    {
+        h ^= *p * HASH_PRIME1;
+        h = ((h << 11) | (h >> 53)) * HASH_PRIME2;
+    }
+    return h;
+}
+
+/* Skrót całej zawartości pliku */
+int hash_file(char *path, size_t chunk, uint64_t *hash)
+{
+    char *buffer = cp_get_buffer(chunk);
+    ssize_t n;
+    int fd;
+
+    if (buffer == NULL) return -1;
+    fd = open(path, O_RDONLY);
+    if (fd == -1) return -1;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    *hash = HASH_PRIME1;
+    while ((n = read(fd, buffer, chunk)) > 0) *hash = hash64_update(*hash, (unsigned char *)buffer, n);
+    close(fd);
+    return n == -1 ? -1 : 0;
+}
+
+/* --update/--checksum: czy cel jest już aktualny */
+int cp_up_to_date(char *src, char *dst, struct stat *src_stat, struct stat *dst_stat, struct cp_opts *opts)
+{
+    uint64_t src_hash, dst_hash;
+    size_t chunk;
+
+    if (!S_ISREG(src_stat->st_mode) || !S_ISREG(dst_stat->st_mode)) return 0;
+    if (src_stat->st_size != dst_stat->st_size) return 0;
+
+    if (opts->update && src_stat->st_mtim.tv_sec == dst_stat->st_mtim.tv_sec
+        && src_stat->st_mtim.tv_nsec == dst_stat->st_mtim.tv_nsec) return 1;
+
+    if (opts->checksum)
+    {
+        chunk = opts->chunk ? opts->chunk : cp_pick_chunk(src_stat, dst_stat, src_stat->st_size);
+        if (hash_file(src, chunk, &src_hash) == -1 || hash_file(dst, chunk, &dst_hash) == -1) return 0;
+        return src_hash == dst_hash;
+    }
+    return 0;
+}
+
+/* Ścieżka dziennika --resume obok pliku docelowego (wynik do zwolnienia) */
+char *journal_path(char *dst)
+{
+    char *path = malloc(strlen(dst) + sizeof(JOURNAL_SUFFIX));
+
+    if (path != NULL) sprintf(path, "%s%s", dst, JOURNAL_SUFFIX);
+    return path;
+}
+
+/* Wczytanie dziennika: liczba zatwierdzonych bloków i ich CRC; 0, gdy dziennik
+   nie istnieje albo opisuje inną wersję źródła */
+long journal_load(char *path, struct stat *src_stat, uint32_t **crcs)
+{
+    FILE *fp;
+    char magic[32];
+    long size, sec, nsec, block, index, count = 0;
+    unsigned crc;
+    uint32_t *grown;
+
+    *crcs = NULL;
+    fp = fopen(path, "r");
+    if (fp == NULL) return 0;
+
+    if (fscanf(fp, "%31s %ld %ld %ld %ld", magic, &size, &sec, &nsec, &block) != 5
+        || strcmp(magic, JOURNAL_MAGIC) != 0 || size != (long)src_stat->st_size
+        || sec != (long)src_stat->st_mtim.tv_sec || nsec != src_stat->st_mtim.tv_nsec || block != RESUME_BLOCK)
+    {
+        fclose(fp);
+        return 0;
+    }
+    while (fscanf(fp, "%ld %x", &index, &crc) == 2 && index == count)
+    {
+        grown = realloc(*crcs, (count + 1) * sizeof(**crcs));
+        if (grown == NULL) break;
+        *crcs = grown;
+        (*crcs)[count++] = crc;
+    }
+    fclose(fp);
+    return count;
+}
+
+/* Zapis nagłówka i zatwierdzonych bloków od nowa; deskryptor do dopisywania */
+int journal_open(char *path, struct stat *src_stat, uint32_t *crcs, long count)
+{
+    FILE *fp;
+    long i;
+    int fd;
+
+    fp = fopen(path, "w");
+    if (fp == NULL) return -1;
+    fprintf(fp, "%s %ld %ld %ld %ld\n", JOURNAL_MAGIC, (long)src_stat->st_size,
+            (long)src_stat->st_mtim.tv_sec, (long)src_stat->st_mtim.tv_nsec, (long)RESUME_BLOCK);
+    for (i = 0; i < count; i++) fprintf(fp, "%ld %08x\n", i, (unsigned)crcs[i]);
+    if (fflush(fp) == EOF || fsync(fileno(fp)) == -1)
+    {
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+
+    fd = open(path, O_WRONLY | O_APPEND | O_CLOEXEC);
+    return fd;
+}
+
+/* cp --resume: kopiowanie blokami RESUME_BLOCK; po każdym bloku dane trafiają na
+   dysk, a do dziennika dopisywany jest jego CRC32C. Ponowne uruchomienie sprawdza
+   ostatnie zatwierdzone bloki celu i kontynuuje od ostatniego poprawnego */
+int copy_resumable(struct cp_file *f, char *dst, struct stat *src_stat, off_t len)
+{
+    struct stat dst_stat;
+    char *path = journal_path(dst);
+    uint32_t *crcs = NULL;
+    uint32_t crc;
+    long count = 0, index;
+    off_t off, blen;
+    int journal_fd;
+    char line[64];
+
+    if (path == NULL)
+    {
+        fprintf(stderr, "cp: out of memory\n");
+        return -1;
+    }
+    if (fstat(f->dst_fd, &dst_stat) == 0 && dst_stat.st_size > 0)
+    {
+        count = journal_load(path, src_stat, &crcs);
+        if (count > dst_stat.st_size / RESUME_BLOCK) count = dst_stat.st_size / RESUME_BLOCK;
+        while (count > 0)
+        {
+            off = (off_t)(count - 1) * RESUME_BLOCK;
+            if (crc32c_range(f->dst_fd, off, RESUME_BLOCK, f->chunk, &crc) == 0 && crc == crcs[count - 1]) break;
+            count--;
+        }
+    }
+
+    journal_fd = journal_open(path, src_stat, crcs, count);
+    free(crcs);
+    if (journal_fd == -1)
+    {
+        perror("cp: journal error");
+        free(path);
+        return -1;
+    }
+    if (count > 0 && f->opts->verbose) printf("cp: resuming '%s' at %ld MB\n", dst, count * (RESUME_BLOCK >> 20));
+    cp_progress_add((off_t)count * RESUME_BLOCK);
+
+    /* CRC liczony w locie: dane idą przez bufor pętlą read/write */
+    f->verify = 1;
+    for (index = count, off = (off_t)count * RESUME_BLOCK; off < len; index++, off += blen)
+    {
+        blen = len - off < RESUME_BLOCK ? len - off : RESUME_BLOCK;
+        f->crc = 0xFFFFFFFFU;
+        f->method = CP_READ_WRITE;
+        if (copy_data(f, off, blen) == -1) break;
+        if (fdatasync(f->dst_fd) == -1)
+        {
+            perror("cp: fdatasync error");
+            break;
+        }
+        sprintf(line, "%ld %08x\n", index, (unsigned)~f->crc);
+        if (write(journal_fd, line, strlen(line)) == -1 || fdatasync(journal_fd) == -1)
+        {
+            perror("cp: journal error");
+            break;
+        }
+    }
+    close(journal_fd);
+
+    if (off < len)
+    {
+        free(path);
+        return -1;
+    }
+    if (ftruncate(f->dst_fd, len) == -1)
+    {
+        perror("cp: ftruncate error");
+        free(path);
+        return -1;
+    }
+    unlink(path);
+    free(path);
+    return 0;
+}
+
+/* Kopiowanie jednego pliku */
+int copy_file(char *src, char *dst, struct cp_opts *opts)
+{
+    struct cp_file f;
+    int src_fd, dst_fd, dst_flags;
+    int rc;
+    int resumed = 0;
+    uint32_t expected;
+    int sparse = 0;
+    off_t len;
+    struct stat src_stat, dst_stat;
+
+    if (stat(src, &src_stat) == -1)
+    {
+        perror("cp: stat error");
+        return -1;
+    }
+
+    if (stat(dst, &dst_stat) == 0)
+    {
+        if (src_stat.st_dev == dst_stat.st_dev && src_stat.st_ino == dst_stat.st_ino)
+        {
+            fprintf(stderr, "cp: '%s' and '%s' are the same file\n", src, dst);
+            return -1;
+        }
+        if ((opts->update || opts->checksum) && cp_up_to_date(src, dst, &src_stat, &dst_stat, opts))
+        {
+            if (opts->verbose) printf("'%s' -> '%s' (unchanged)\n", src, dst);
+            cp_progress_add(src_stat.st_size);
+            return 0;
+        }
+    }
+
+    /* --direct: O_DIRECT tam, gdzie system plików je przyjmuje */
+    src_fd = open(src, O_RDONLY | (opts->direct ? O_DIRECT : 0));
+    if (src_fd == -1 && opts->direct && errno == EINVAL) src_fd = open(src, O_RDONLY);
+    if (src_fd == -1)
+    {
+        perror("cp: source error");
+        return -1;
+    }
+
+    /* Po CTRL+C kolejne pliki nie są już otwierane (O_TRUNC wyzerowałby cel) */
+    if (cp_interrupted())
+    {
+        close(src_fd);
+        return -1;
+    }
+
+    /* --resume: istniejąca zawartość celu jest potrzebna do kontynuacji */
+    dst_flags = O_CREAT | (opts->resume ? O_RDWR : O_WRONLY | O_TRUNC);
+    dst_fd = open(dst, dst_flags | (opts->direct ? O_DIRECT : 0), src_stat.st_mode);
+    if (dst_fd == -1 && opts->direct && errno == EINVAL) dst_fd = open(dst, dst_flags, src_stat.st_mode);
+    if (dst_fd == -1)
+    {
+        perror("cp: destination error");
+        close(src_fd);
+        return -1;
+    }
+    if (fstat(dst_fd, &dst_stat) == -1)
+    {
+        perror("cp: stat error");
+        close(src_fd);
+        close(dst_fd);
+        return -1;
+    }
+
+    /* Pliki bez rozmiaru (np. /proc) i nie-regularne czytamy do EOF */
+    len = (S_ISREG(src_stat.st_mode) && src_stat.st_size > 0) ? src_stat.st_size : -1;
+
+    /* --resume bez O_TRUNC: pusty lub nie-regularny plik nie jest wznawiany, więc stara
+       zawartość celu jest usuwana jak przy zwykłym kopiowaniu */
+    if (opts->resume && len <= 0 && S_ISREG(dst_stat.st_mode) && ftruncate(dst_fd, 0) == -1)
+    {
+        perror("cp: ftruncate error");
+        close(src_fd);
+        close(dst_fd);
+        return -1;
+    }
+
+    f.src_fd = src_fd;
+    f.dst_fd = dst_fd;
+    f.method = CP_NONE;
+    f.direct = opts->direct;
+    f.verify = opts->verify;
+    f.crc = 0xFFFFFFFFU;
+    f.chunk = opts->chunk ? opts->chunk : cp_pick_chunk(&src_stat, &dst_stat, len);
+    if (f.direct) f.chunk = (f.chunk + DIRECT_ALIGN - 1) / DIRECT_ALIGN * DIRECT_ALIGN;
+    f.opts = opts;
+
+    if (opts->resume && len > 0)
+    {
+        resumed = 1;
+        rc = copy_resumable(&f, dst, &src_stat, len);
+    }
+    /* FICLONE: współdzielenie bloków (btrfs, XFS), copy_file_range też może klonować */
+    else if (opts->reflink != REFLINK_NEVER && len > 0 && ioctl(dst_fd, FICLONE, src_fd) == 0)
+    {
+        f.method = CP_REFLINK;
+        cp_progress_add(len);
+        rc = 0;
+    }
+    else if (opts->reflink == REFLINK_ALWAYS && len > 0)
+    {
+        perror("cp: failed to clone");
+        rc = -1;
+    }
+    else
+    {
+        sparse = len > 0 && S_ISREG(dst_stat.st_mode) && (off_t)src_stat.st_blocks * 512 < len;
+
+        /* Rezerwacja całego rozmiaru z góry (ciągły plik) i podpowiedzi dla odczytu sekwencyjnego */
+        if (len > 0 && !sparse && fallocate(dst_fd, FALLOC_FL_KEEP_SIZE, 0, len) == -1 && errno == ENOSPC)
+        {
+            perror("cp: fallocate error");
+            close(src_fd);
+            close(dst_fd);
+            return -1;
+        }
+        posix_fadvise(src_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        posix_fadvise(src_fd, 0, 0, POSIX_FADV_NOREUSE);
+
+        /* --verify: dane muszą przejść przez bufor, aby policzyć CRC w locie */
+        if (f.direct || f.verify) f.method = CP_READ_WRITE;
+        else f.method = opts->reflink == REFLINK_NEVER ? CP_IO_URING : CP_COPY_FILE_RANGE;
+        if (sparse) rc = copy_sparse(&f, len);
+        else rc = copy_data(&f, 0, len);
+    }
+    /* Zachowanie czasu modyfikacji źródła, aby kolejne --update mogło pominąć plik */
+    if (rc == 0 && (opts->update || opts->checksum))
+    {
+        struct timespec times[2];
+
+        times[0] = src_stat.st_atim;
+        times[1] = src_stat.st_mtim;
+        if (futimens(dst_fd, times) == -1) perror("cp: futimens error");
+    }
+    if (rc == 0 && opts->verify)
+    {
+        /* Po wznowieniu strumień objął tylko część pliku, a klon nie przechodzi przez bufor:
+           CRC źródła liczony od nowa */
+        expected = ~f.crc;
+        if ((resumed || f.method == CP_REFLINK) && crc32c_file(src, f.chunk, &expected) == -1)
+        {
+            perror("cp: verify read error");
+            rc = -1;
+        }
+        if (rc == 0) rc = cp_verify(dst, dst_fd, expected, f.chunk);
+    }
+    if (rc == 0 && opts->verbose)
+    {
+        printf("'%s' -> '%s' (%s%s%s)\n", src, dst, cp_method_names[f.method],
+               sparse ? ", sparse" : "", f.direct ? ", direct" : "");
+    }
+
+    close(src_fd);
+    close(dst_fd);
+    return rc;
+}
+
+/* Dodanie zadania na koniec kolejki */
+int cp_deque_push(struct cp_deque *q, struct cp_job job)
+{
+    struct cp_job *grown;
+
+    pthread_mutex_lock(&q->lock);
+    if (q->tail == q->cap)
+    {
+        if (q->head > 0)
+        {
+            memmove(q->jobs, q->jobs + q->head, (q->tail - q->head) * sizeof(*q->jobs));
+            q->tail -= q->head;
+            q->head = 0;
+        }
+        else
+        {
+            grown = realloc(q->jobs, (q->cap ? q->cap * 2 : 64) * sizeof(*q->jobs));
+            if (grown == NULL)
+            {
+                pthread_mutex_unlock(&q->lock);
+                return -1;
+            }
+            q->jobs = grown;
+            q->cap = q->cap ? q->cap * 2 : 64;
+        }
+    }
+    q->jobs[q->tail++] = job;
+    pthread_mutex_unlock(&q->lock);
+    return 0;
+}
+
+/* Pobranie zadania: własne z końca (steal == 0) albo cudze z początku */
+int cp_deque_pop(struct cp_deque *q, struct cp_job *job, int steal)
+{
+    int found = 0;
+
+    pthread_mutex_lock(&q->lock);
+    if (q->head < q->tail)
+    {
+        *job = steal ? q->jobs[q->head++] : q->jobs[--q->tail];
+        if (q->head == q->tail) q->head = q->tail = 0;
+        found = 1;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return found;
+}
+
+/* Wątek roboczy: własna kolejka, potem kradzież, potem czekanie */
+void *cp_worker_main(void *arg)
+{
+    struct cp_worker *w = arg;
+    struct cp_pool *pool = w->pool;
+    struct cp_job job;
+    int i, found;
+
+    for (;;)
+    {
+        found = cp_deque_pop(&pool->queues[w->id], &job, 0);
+        for (i = 1; !found && i < pool->nthreads; i++)
+        {
+            found = cp_deque_pop(&pool->queues[(w->id + i) % pool->nthreads], &job, 1);
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        if (found) pool->pending--;
+        else if (pool->pending == 0)
+        {
+            if (!pool->walking)
+            {
+                pthread_mutex_unlock(&pool->lock);
+                break;
+            }
+            pthread_cond_wait(&pool->cond, &pool->lock);
+        }
+        pthread_mutex_unlock(&pool->lock);
+
+        if (found)
+        {
+            /* Po CTRL+C kolejka jest tylko opróżniana */
+            if (cp_interrupted() || copy_file(job.src, job.dst, pool->opts) == -1)
+            {
+                pthread_mutex_lock(&pool->lock);
+                pool->errors++;
+                pthread_mutex_unlock(&pool->lock);
+            }
+            free(job.src);
+            free(job.dst);
+        }
+    }
+    cp_release_buffer();
+    return NULL;
+}
+
+/* Zlecenie kopiowania pliku kolejnemu wątkowi (round-robin) */
+int cp_pool_submit(struct cp_pool *pool, char *src, char *dst)
+{
+    struct cp_job job;
+    int rc = 0;
+
+    job.src = strdup(src);
+    job.dst = strdup(dst);
+
+    /* Licznik rośnie przed wstawieniem: wątek, który od razu zdejmie zadanie, nie zejdzie poniżej zera */
+    pthread_mutex_lock(&pool->lock);
+    pool->pending++;
+    pthread_mutex_unlock(&pool->lock);
+    if (job.src == NULL || job.dst == NULL || cp_deque_push(&pool->queues[pool->next], job) == -1)
+    {
+        fprintf(stderr, "cp: out of memory\n");
+        free(job.src);
+        free(job.dst);
+        rc = -1;
+    }
+    pool->next = (pool->next + 1) % pool->nthreads;
+
+    pthread_mutex_lock(&pool->lock);
+    if (rc == -1) pool->pending--;
+    pthread_cond_signal(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+    return rc;
+}
+
+/* Złożenie ścieżki katalog/nazwa */
+char *path_join(char *dir, char *name)
+{
+    size_t len = strlen(dir);
+    char *path = malloc(len + strlen(name) + 2);
+
+    if (path == NULL) return NULL;
+    if (len > 0 && dir[len - 1] == '/') sprintf(path, "%s%s", dir, name);
+    else sprintf(path, "%s/%s", dir, name);
+    return path;
+}
+
+/* Czy istniejące dowiązanie wskazuje na ten sam cel (ponowne cp -r) */
+int cp_same_link(char *path, char *target)
+{
+    char buf[PATH_MAX_LEN];
+    ssize_t len = readlink(path, buf, sizeof(buf) - 1);
+
+    if (len == -1) return 0;
+    buf[len] = '\0';
+    return strcmp(buf, target) == 0;
+}
+
+/* Zapamiętanie katalogu, którego prawa trzeba przywrócić po skopiowaniu jego zawartości */
+int cp_pool_add_dir(struct cp_pool *pool, char *path, mode_t mode)
+{
+    struct cp_dir *grown;
+
+    if (pool->ndirs == pool->dirs_cap)
+    {
+        grown = realloc(pool->dirs, (pool->dirs_cap ? pool->dirs_cap * 2 : 16) * sizeof(*pool->dirs));
+        if (grown == NULL) return -1;
+        pool->dirs = grown;
+        pool->dirs_cap = pool->dirs_cap ? pool->dirs_cap * 2 : 16;
+    }
+    pool->dirs[pool->ndirs].path = strdup(path);
+    if (pool->dirs[pool->ndirs].path == NULL) return -1;
+    pool->dirs[pool->ndirs++].mode = mode;
+    return 0;
+}
+
+/* Czy DST leży wewnątrz katalogu SRC (cp -r . sub kopiowałoby się bez końca) */
+int cp_into_itself(char *src, char *dst)
+{
+    char src_real[PATH_MAX_LEN], dst_real[PATH_MAX_LEN];
+    char *parent, *slash;
+    size_t len;
+    int found;
+
+    if (realpath(src, src_real) == NULL) return 0;
+    if (realpath(dst, dst_real) == NULL)
+    {
+        /* Cel jeszcze nie istnieje: rozwiązywany jest katalog nadrzędny */
+        parent = strdup(dst);
+        if (parent == NULL) return 0;
+        slash = strrchr(parent, '/');
+        if (slash == NULL) found = realpath(".", dst_real) != NULL;
+        else
+        {
+            *slash = '\0';
+            found = realpath(slash == parent ? "/" : parent, dst_real) != NULL;
+        }
+        free(parent);
+        if (!found) return 0;
+    }
+
+    len = strlen(src_real);
+    if (len == 1) return 1;
+    return strncmp(dst_real, src_real, len) == 0 && (dst_real[len] == '\0' || dst_real[len] == '/');
+}
+
+/* Przejście drzewa w wątku głównym: katalog powstaje przed zleceniem plików z jego wnętrza */
+int copy_tree(struct cp_pool *pool, char *src, char *dst)
+{
+    struct stat st;
+    DIR *dir;
+    struct dirent *entry;
+    char *src_path, *dst_path;
+    char link_buf[PATH_MAX_LEN];
+    ssize_t link_len;
+    int rc = 0;
+
+    if (lstat(src, &st) == -1)
+    {
+        perror("cp: stat error");
+        return -1;
+    }
+
+    if (S_ISREG(st.st_mode))
+    {
+        if (cp_prog.active) __atomic_add_fetch(&cp_prog.total, st.st_size, __ATOMIC_RELAXED);
+        return cp_pool_submit(pool, src, dst);
+    }
+
+    if (S_ISLNK(st.st_mode))
+    {
+        link_len = readlink(src, link_buf, sizeof(link_buf) - 1);
+        if (link_len == -1)
+        {
+            perror("cp: readlink error");
+            return -1;
+        }
+        link_buf[link_len] = '\0';
+        if (symlink(link_buf, dst) == -1 && !(errno == EEXIST && cp_same_link(dst, link_buf)))
+        {
+            perror("cp: symlink error");
+            return -1;
+        }
+        return 0;
+    }
+
+    if (!S_ISDIR(st.st_mode))
+    {
+        fprintf(stderr, "cp: '%s': skipping special file\n", src);
+        return -1;
+    }
+
+    /* Właściciel musi móc zapisywać do katalogu, dopóki trwa kopiowanie; docelowe prawa
+       są nadawane po zakończeniu wszystkich wątków */
+    if (mkdir(dst, (st.st_mode & 07777) | S_IRWXU) == 0)
+    {
+        if ((st.st_mode & S_IRWXU) != S_IRWXU && cp_pool_add_dir(pool, dst, st.st_mode & 07777 & ~pool->umask) == -1)
+        {
+            fprintf(stderr, "cp: out of memory\n");
+            return -1;
+        }
+    }
+    else if (errno != EEXIST)
+    {
+        perror("cp: mkdir error");
+        return -1;
+    }
+
+    dir = opendir(src);
+    if (dir == NULL)
+    {
+        perror("cp: opendir error");
+        return -1;
+    }
+
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (cp_interrupted())
+        {
+            rc = -1;
+            break;
+        }
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+
+        src_path = path_join(src, entry->d_name);
+        dst_path = path_join(dst, entry->d_name);
+        if (src_path == NULL || dst_path == NULL)
+        {
+            fprintf(stderr, "cp: out of memory\n");
+            rc = -1;
+        }
+        else if (copy_tree(pool, src_path, dst_path) == -1) rc = -1;
+        free(src_path);
+        free(dst_path);
+    }
+
+    closedir(dir);
+    return rc;
+}
+
+/* cp -r: równoległe kopiowanie drzewa katalogów */
+int copy_recursive(char *src, char *dst, struct cp_opts *opts)
+{
+    struct cp_pool *pool;
+    struct cp_worker workers[CP_POOL_MAX];
+    sigset_t chld, prev;
+    long ncpu;
+    int i, rc;
+
+    if (cp_into_itself(src, dst))
+    {
+        fprintf(stderr, "cp: cannot copy a directory, '%s', into itself, '%s'\n", src, dst);
+        return -1;
+    }
+
+    pool = calloc(1, sizeof(*pool));
+    if (pool == NULL)
+    {
+        fprintf(stderr, "cp: out of memory\n");
+        return -1;
+    }
+
+    ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    pool->nthreads = ncpu < 1 ? 1 : (ncpu > CP_POOL_MAX ? CP_POOL_MAX : (int)ncpu);
+    pool->walking = 1;
+    pool->opts = opts;
+    pool->umask = umask(0);
+    umask(pool->umask);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+
+    for (i = 0; i < pool->nthreads; i++)
+    {
+        pthread_mutex_init(&pool->queues[i].lock, NULL);
+        workers[i].pool = pool;
+        workers[i].id = i;
+    }
+    /* Wątki robocze nie obsługują SIGCHLD: zadania w tle zbiera główny wątek */
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    pthread_sigmask(SIG_BLOCK, &chld, &prev);
+    for (i = 0; i < pool->nthreads; i++)
+    {
+        if (pthread_create(&pool->threads[i], NULL, cp_worker_main, &workers[i]) != 0)
+        {
+            perror("cp: pthread_create");
+            break;
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &prev, NULL);
+    if (i == 0) pool->nthreads = 1;
+
+    rc = copy_tree(pool, src, dst);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->walking = 0;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    if (i == 0) cp_worker_main(&workers[0]);
+    while (i > 0) pthread_join(pool->threads[--i], NULL);
+
+    /* Prawa katalogów od najgłębszych: zawartość każdego jest już skopiowana */
+    for (i = pool->ndirs - 1; i >= 0; i--)
+    {
+        if (chmod(pool->dirs[i].path, pool->dirs[i].mode) == -1)
+        {
+            perror("cp: chmod error");
+            rc = -1;
+        }
+        free(pool->dirs[i].path);
+    }
+    free(pool->dirs);
+
+    if (pool->errors > 0) rc = -1;
+    for (i = 0; i < CP_POOL_MAX; i++)
+    {
+        if (i < pool->nthreads) pthread_mutex_destroy(&pool->queues[i].lock);
+        free(pool->queues[i].jobs);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->cond);
+    free(pool);
+    return rc;
+}
+
+/* Rozmiar z przyrostkiem K/M/G, 0 przy błędzie */
+size_t parse_size(char *text)
+{
+    char *end;
+    unsigned long value = strtoul(text, &end, 10);
+
+    if (end == text) return 0;
+    if (*end == 'K' || *end == 'k') { value <<= 10; end++; }
+    else if (*end == 'M' || *end == 'm') { value <<= 20; end++; }
+    else if (*end == 'G' || *end == 'g') { value <<= 30; end++; }
+    return *end == '\0' ? value : 0;
+}
+
+/* Ścieżka celu: dla istniejącego katalogu DST/nazwa_źródła (wynik do zwolnienia);
+   końcowe '/' źródła są pomijane bez zmiany samego argumentu */
+char *cp_target(const char *src, char *dst)
+{
+    struct stat st;
+    const char *base, *end = src + strlen(src);
+    char *name, *path;
+
+    if (stat(dst, &st) == -1 || !S_ISDIR(st.st_mode)) return strdup(dst);
+
+    while (end > src + 1 && end[-1] == '/') end--;
+    for (base = end; base > src && base[-1] != '/'; base--);
+    name = strndup(base, end - base);
+    if (name == NULL) return NULL;
+    path = path_join(dst, name);
+    free(name);
+    return path;
+}
+
+/* Przeniesienie dokładnie n bajtów z potoku do pliku */
+int splice_all(int pipe_fd, int fd, size_t n)
+{
+    ssize_t moved;
+
+    while (n > 0)
+    {
+        moved = splice(pipe_fd, NULL, fd, NULL, n, SPLICE_F_MOVE);
+        if (moved == -1) return -1;
+        if (moved == 0)
+        {
+            errno = EIO;
+            return -1;
+        }
+        n -= moved;
+    }
+    return 0;
+}
+
+/* Rozsyłanie w jądrze: splice() źródła do potoku, tee() do potoków pozostałych
+   celów, splice() z potoków do plików; 0 - gotowe, 1 - nieobsługiwane, -1 - błąd */
+int fanout_splice(int src_fd, int *dst_fds, int ndst, off_t *done)
+{
+    int (*pipes)[2];
+    ssize_t n;
+    long size;
+    size_t chunk = 0;
+    int k, opened, rc = 0;
+    off_t in_off = *done;
+
+    pipes = malloc(ndst * sizeof(*pipes));
+    if (pipes == NULL) return 1;
+    for (opened = 0; opened < ndst; opened++)
+    {
+        if (pipe2(pipes[opened], O_CLOEXEC) == -1) break;
+        fcntl(pipes[opened][1], F_SETPIPE_SZ, URING_BUF_SIZE);
+        size = fcntl(pipes[opened][1], F_GETPIPE_SZ);
+        if (size > 0 && (chunk == 0 || (size_t)size < chunk)) chunk = size;
+    }
+    if (opened < ndst || chunk == 0) rc = 1;
+
+    while (rc == 0)
+    {
+        if (cp_interrupted())
+        {
+            rc = -1;
+            break;
+        }
+        n = splice(src_fd, &in_off, pipes[0][1], NULL, chunk, SPLICE_F_MOVE);
+        if (n == 0) break;
+        if (n == -1)
+        {
+            /* ESPIPE: źródło bez pozycji (potok, FIFO) - zostaje pętla read/write */
+            rc = *done == 0 && (cp_unsupported(errno) || errno == ESPIPE) ? 1 : -1;
+            if (rc == -1) perror("cp: splice error");
+            break;
+        }
+
+        /* Puste potoki tej samej pojemności: tee() powiela cały kawałek naraz */
+        for (k = 1; k < ndst && rc == 0; k++)
+        {
+            if (tee(pipes[0][0], pipes[k][1], n, 0) != n) rc = 1;
+        }
+        for (k = ndst - 1; k >= 0 && rc == 0; k--)
+        {
+            if (splice_all(pipes[k][0], dst_fds[k], n) == -1)
+            {
+                rc = cp_unsupported(errno) ? 1 : -1;
+                if (rc == -1) perror("cp: splice error");
+            }
+        }
+        if (rc == 0)
+        {
+            cp_progress_add(n);
+            *done += n;
+        }
+    }
+
+    for (k = 0; k < opened; k++)
+    {
+        close(pipes[k][0]);
+        close(pipes[k][1]);
+    }
+    free(pipes);
+    return rc;
+}
+
+/* Rozesłanie len bajtów źródła od jego bieżącej pozycji (len < 0: do EOF) pod offset off w celach;
+   przy blk > 0 bloki wyrównane do blk i złożone z samych zer są pomijane i zostają dziurami */
+int fanout_range(int src_fd, int *dst_fds, int ndst, off_t off, off_t len, size_t chunk, uint32_t *crc, size_t blk)
+{
+    char *buffer = cp_get_buffer(chunk);
+    ssize_t n_read, n_written, written, pos, end, next;
+    int k;
+
+    if (buffer == NULL)
+    {
+        perror("cp: buffer allocation error");
+        return -1;
+    }
+    while (len != 0)
+    {
+        if (cp_interrupted()) return -1;
+        n_read = read(src_fd, buffer, len < 0 || len > (off_t)chunk ? chunk : (size_t)len);
+        if (n_read == -1)
+        {
+            perror("cp: read error");
+            return -1;
+        }
+        if (n_read == 0) break;
+        if (crc != NULL) *crc = crc32c_update(*crc, (unsigned char *)buffer, n_read);
+
+        for (pos = 0; pos < n_read; pos = end)
+        {
+            end = n_read;
+            if (blk > 0)
+            {
+                /* Zerowe bloki pomijamy, kolejne niezerowe łączymy w jeden zapis */
+                end = pos + (ssize_t)(blk - (size_t)((off + pos) % (off_t)blk));
+                if (end > n_read) end = n_read;
+                if (buffer[pos] == 0 && memcmp(buffer + pos, buffer + pos + 1, end - pos - 1) == 0) continue;
+                for (; end < n_read; end = next)
+                {
+                    next = end + (ssize_t)blk < n_read ? end + (ssize_t)blk : n_read;
+                    if (buffer[end] == 0 && memcmp(buffer + end, buffer + end + 1, next - end - 1) == 0) break;
+                }
+            }
+            for (k = 0; k < ndst; k++)
+            {
+                for (written = pos; written < end; written += n_written)
+                {
+                    n_written = blk > 0 ? pwrite(dst_fds[k], buffer + written, end - written, off + written)
+                                        : write(dst_fds[k], buffer + written, end - written);
+                    if (n_written == -1)
+                    {
+                        perror("cp: write error");
+                        return -1;
+                    }
+                }
+            }
+        }
+        cp_progress_add(n_read);
+        off += n_read;
+        if (len > 0) len -= n_read;
+    }
+    return 0;
+}
+
+/* Kopiowanie do wielu celów przez read/write; rzadkie źródło (len > 0) jak w copy_sparse:
+   tylko zakresy danych (SEEK_DATA/SEEK_HOLE), a w nich zerowe bloki blk bajtów też pomijane */
+int fanout_read_write(int src_fd, int *dst_fds, int ndst, off_t done, size_t chunk, uint32_t *crc, off_t len, size_t blk)
+{
+    off_t off = 0;
+    off_t data, hole;
+    int k;
+
+    if (len == 0)
+    {
+        lseek(src_fd, done, SEEK_SET);
+        for (k = 0; k < ndst; k++) lseek(dst_fds[k], done, SEEK_SET);
+        return fanout_range(src_fd, dst_fds, ndst, done, -1, chunk, crc, 0);
+    }
+
+    while (off < len)
+    {
+        data = lseek(src_fd, off, SEEK_DATA);
+        if (data == -1)
+        {
+            if (errno == ENXIO) break;
+            if (off == 0)
+            {
+                data = 0;
+                hole = len;
+            }
+            else
+            {
+                perror("cp: lseek error");
+                return -1;
+            }
+        }
+        else
+        {
+            if (data >= len) break;
+            hole = lseek(src_fd, data, SEEK_HOLE);
+            if (hole == -1 || hole > len) hole = len;
+        }
+        if (crc != NULL) *crc = crc32c_zeros(*crc, data - off);
+        cp_progress_add(data - off);
+
+        if (lseek(src_fd, data, SEEK_SET) == -1)
+        {
+            perror("cp: lseek error");
+            return -1;
+        }
+        if (fanout_range(src_fd, dst_fds, ndst, data, hole - data, chunk, crc, blk) == -1) return -1;
+        off = hole;
+    }
+    if (crc != NULL && off < len) *crc = crc32c_zeros(*crc, len - off);
+    if (off < len) cp_progress_add(len - off);
+
+    for (k = 0; k < ndst; k++)
+    {
+        if (ftruncate(dst_fds[k], len) == -1)
+        {
+            perror("cp: ftruncate error");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* cp SRC DST1 DST2 ...: źródło czytane jeden raz niezależnie od liczby celów */
+int copy_fanout(char *src, char **dsts, int ndst, struct cp_opts *opts)
+{
+    struct stat src_stat, dst_stat;
+    int *dst_fds;
+    int src_fd, k, opened, rc = 0;
+    int sparse;
+    int method = CP_TEE;
+    off_t done = 0;
+    uint32_t crc = 0xFFFFFFFFU;
+    size_t chunk;
+
+    if (stat(src, &src_stat) == -1)
+    {
+        perror("cp: stat error");
+        return -1;
+    }
+    chunk = opts->chunk ? opts->chunk : cp_pick_chunk(&src_stat, &src_stat, src_stat.st_size);
+    for (k = 0; k < ndst; k++)
+    {
+        if (stat(dsts[k], &dst_stat) == 0 && src_stat.st_dev == dst_stat.st_dev && src_stat.st_ino == dst_stat.st_ino)
+        {
+            fprintf(stderr, "cp: '%s' and '%s' are the same file\n", src, dsts[k]);
+            return -1;
+        }
+    }
+
+    dst_fds = malloc(ndst * sizeof(*dst_fds));
+    if (dst_fds == NULL)
+    {
+        fprintf(stderr, "cp: out of memory\n");
+        return -1;
+    }
+    src_fd = open(src, O_RDONLY);
+    if (src_fd == -1)
+    {
+        perror("cp: source error");
+        free(dst_fds);
+        return -1;
+    }
+    for (opened = 0; opened < ndst; opened++)
+    {
+        dst_fds[opened] = open(dsts[opened], O_WRONLY | O_CREAT | O_TRUNC, src_stat.st_mode);
+        if (dst_fds[opened] == -1)
+        {
+            fprintf(stderr, "cp: destination error: %s: %s\n", dsts[opened], strerror(errno));
+            rc = -1;
+            break;
+        }
+    }
+
+    /* Jak w copy_file: rzadkie źródło daje rzadkie cele, pozostałe mają miejsce zarezerwowane z góry */
+    sparse = S_ISREG(src_stat.st_mode) && src_stat.st_size > 0 && (off_t)src_stat.st_blocks * 512 < src_stat.st_size;
+    for (k = 0; k < ndst && rc == 0 && sparse; k++)
+    {
+        if (fstat(dst_fds[k], &dst_stat) == -1 || !S_ISREG(dst_stat.st_mode)) sparse = 0;
+    }
+    for (k = 0; k < ndst && rc == 0 && !sparse && S_ISREG(src_stat.st_mode) && src_stat.st_size > 0; k++)
+    {
+        if (fallocate(dst_fds[k], FALLOC_FL_KEEP_SIZE, 0, src_stat.st_size) == -1 && errno == ENOSPC)
+        {
+            perror("cp: fallocate error");
+            rc = -1;
+        }
+    }
+
+    if (rc == 0)
+    {
+        posix_fadvise(src_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        rc = opts->verify || sparse ? 1 : fanout_splice(src_fd, dst_fds, ndst, &done);
+        if (rc == 1)
+        {
+            method = CP_READ_WRITE;
+            rc = fanout_read_write(src_fd, dst_fds, ndst, done, chunk, opts->verify ? &crc : NULL,
+                                   sparse ? src_stat.st_size : 0, src_stat.st_blksize > 512 ? src_stat.st_blksize : 512);
+        }
+        for (k = 0; k < ndst && rc == 0 && opts->verify; k++) rc = cp_verify(dsts[k], dst_fds[k], ~crc, chunk);
+    }
+    if (rc == 0 && opts->verbose)
+    {
+        for (k = 0; k < ndst; k++) printf("'%s' -> '%s' (%s)\n", src, dsts[k], cp_method_names[method]);
+    }
+
+    while (opened > 0) close(dst_fds[--opened]);
+    close(src_fd);
+    free(dst_fds);
+    return rc;
+}
+
+/* Funkcja cp */
+int builtin_cp(char **args)
+{
+    struct cp_opts opts;
+    struct stat st;
+    char **operands;
+    char *src;
+    int count = 0;
+    int i, rc = -1;
+
+    memset(&opts, 0, sizeof(opts));
+    interrupted = 0;
+
+    for (i = 1; args[i] != NULL; i++);
+    operands = malloc(i * sizeof(*operands));
+    if (operands == NULL)
+    {
+        fprintf(stderr, "cp: out of memory\n");
+        return 1;
+    }
+
+    for (i = 1; args[i] != NULL; i++)
+    {
+        if (args[i][0] == '-' && args[i][1] != '-' && args[i][1] != '\0' && strspn(args[i] + 1, "vrRu") == strlen(args[i] + 1))
+        {
+            if (strchr(args[i], 'v') != NULL) opts.verbose = 1;
+            if (strchr(args[i], 'u') != NULL) opts.update = 1;
+            if (strpbrk(args[i], "rR") != NULL) opts.recursive = 1;
+        }
+        else if (strcmp(args[i], "--reflink") == 0 || strcmp(args[i], "--reflink=always") == 0) opts.reflink = REFLINK_ALWAYS;
+        else if (strcmp(args[i], "--reflink=auto") == 0) opts.reflink = REFLINK_AUTO;
+        else if (strcmp(args[i], "--reflink=never") == 0) opts.reflink = REFLINK_NEVER;
+        else if (strcmp(args[i], "--direct") == 0) opts.direct = 1;
+        else if (strcmp(args[i], "--update") == 0) opts.update = 1;
+        else if (strcmp(args[i], "--checksum") == 0) opts.checksum = 1;
+        else if (strcmp(args[i], "--verify") == 0) opts.verify = 1;
+        else if (strcmp(args[i], "--progress") == 0) opts.progress = 1;
+        else if (strcmp(args[i], "--resume") == 0) opts.resume = 1;
+        else if (strncmp(args[i], "--bs=", 5) == 0)
+        {
+            opts.chunk = parse_size(args[i] + 5);
+            if (opts.chunk == 0 || opts.chunk > CP_CHUNK_MAX)
+            {
+                fprintf(stderr, "cp: invalid buffer size '%s'\n", args[i] + 5);
+                free(operands);
+                return 1;
+            }
+        }
+        else if (args[i][0] == '-' && args[i][1] != '\0')
+        {
+            fprintf(stderr, "cp: invalid option '%s'\n", args[i]);
+            free(operands);
+            return 1;
+        }
+        else operands[count++] = args[i];
+    }
+
+    if (count < 2)
+    {
+        fprintf(stderr, "cp: missing file operand\n");
+        free(operands);
+        return 1;
+    }
+
+    src = operands[0];
+    if (stat(src, &st) == -1)
+    {
+        perror("cp: stat error");
+        free(operands);
+        return 1;
+    }
+    /* Rozsyłanie nie klonuje, nie pomija aktualnych celów, nie wznawia i nie używa O_DIRECT */
+    if (count > 2 && (opts.reflink == REFLINK_ALWAYS || opts.direct || opts.update || opts.checksum || opts.resume))
+    {
+        fprintf(stderr, "cp: %s cannot be used with several destinations\n",
+                opts.reflink == REFLINK_ALWAYS ? "--reflink=always" : opts.direct ? "--direct" :
+                opts.resume ? "--resume" : opts.checksum ? "--checksum" : "--update");
+        free(operands);
+        return 1;
+    }
+    if (S_ISDIR(st.st_mode) && (!opts.recursive || count > 2))
+    {
+        if (opts.recursive) fprintf(stderr, "cp: cannot fan out directory '%s' to several destinations\n", src);
+        else fprintf(stderr, "cp: -r not specified; omitting directory '%s'\n", src);
+        free(operands);
+        return 1;
+    }
+
+    /* Cel będący katalogiem: kopiujemy do DST/nazwa_źródła */
+    for (i = 1; i < count; i++)
+    {
+        operands[i] = cp_target(src, operands[i]);
+        if (operands[i] == NULL) break;
+    }
+
+    if (i < count)
+    {
+        fprintf(stderr, "cp: out of memory\n");
+        count = i;
+    }
+    else
+    {
+        if (opts.progress) cp_progress_begin(S_ISREG(st.st_mode) ? st.st_size : 0);
+        if (count > 2) rc = copy_fanout(src, operands + 1, count - 1, &opts);
+        else if (opts.recursive) rc = copy_recursive(src, operands[1], &opts);
+        else rc = copy_file(src, operands[1], &opts);
+        if (opts.progress) cp_progress_end();
+    }
+
+    if (cp_interrupted()) fprintf(stderr, "cp: interrupted\n");
+    for (i = 1; i < count; i++) free(operands[i]);
+    free(operands);
+    /* Bufor wątku głównego zostaje na następne polecenie, ale nie większy niż CP_BUF_MAX
+       (po --bs=1G powłoka nie trzyma gigabajta) */
+    if (cp_buffer_size > CP_BUF_MAX) cp_release_buffer();
+    return rc < 0 ? 1 : 0;
+}
+
+/* Indeks kubełka dla nazwy polecenia (FNV-1a) */
+unsigned path_bucket(const char *name)
+{
+    unsigned h = 2166136261U;
+
+    while (*name) h = (h ^ (unsigned char)*name++) * 16777619U;
+    return h % PATH_BUCKETS;
+}
+
+/* Usunięcie wszystkich zapamiętanych ścieżek */
+void path_cache_clear()
+{
+    struct path_entry *e, *next;
+    int i;
+
+    for (i = 0; i < PATH_BUCKETS; i++)
+    {
+        for (e = path_table[i]; e != NULL; e = next)
+        {
+            next = e->next;
+            free(e->name);
+            free(e->path);
+            free(e);
+        }
+        path_table[i] = NULL;
+    }
+}
+
+/* Czas modyfikacji katalogu (zero, gdy katalog nie istnieje) */
+struct timespec path_dir_mtime(char *dir)
+{
+    struct stat st;
+    struct timespec zero = { 0, 0 };
+
+    return stat(dir, &st) == 0 ? st.st_mtim : zero;
+}
+
+/* Zmiana PATH: nowa lista katalogów i ich czasów modyfikacji, pamięć opróżniona */
+void path_cache_sync()
+{
+    char *env = getenv("PATH");
+    char *copy, *dir, *save;
+    int i, count = 1;
+
+    if (env == NULL) env = "/usr/local/bin:/usr/bin:/bin";
+    if (path_env != NULL && strcmp(path_env, env) == 0) return;
+
+    path_cache_clear();
+    for (i = 0; i < path_ndirs; i++) free(path_dirs[i]);
+    free(path_dirs);
+    free(path_mtimes);
+    free(path_env);
+    path_dirs = NULL;
+    path_mtimes = NULL;
+    path_ndirs = 0;
+
+    path_env = strdup(env);
+    copy = strdup(env);
+    if (path_env == NULL || copy == NULL)
+    {
+        free(copy);
+        return;
+    }
+    /* N dwukropków to N + 1 elementów, także pustych */
+    for (dir = env; (dir = strchr(dir, ':')) != NULL; dir++) count++;
+    path_dirs = malloc(count * sizeof(*path_dirs));
+    path_mtimes = malloc(count * sizeof(*path_mtimes));
+    if (path_dirs != NULL && path_mtimes != NULL)
+    {
+        /* Pusty element PATH oznacza katalog bieżący */
+        for (dir = copy; dir != NULL; dir = save)
+        {
+            save = strchr(dir, ':');
+            if (save != NULL) *save++ = '\0';
+            path_dirs[path_ndirs] = strdup(*dir ? dir : ".");
+            if (path_dirs[path_ndirs] == NULL) break;
+            path_mtimes[path_ndirs] = path_dir_mtime(path_dirs[path_ndirs]);
+            path_ndirs++;
+        }
+    }
+    free(copy);
+}
+
+/* Czy któryś z katalogów 0..upto zmienił się od zapamiętania (nowy plik mógłby przesłonić wpis) */
+int path_dirs_changed(int upto)
+{
+    struct timespec now;
+    int i, changed = 0;
+
+    for (i = 0; i <= upto && i < path_ndirs; i++)
+    {
+        now = path_dir_mtime(path_dirs[i]);
+        if (now.tv_sec != path_mtimes[i].tv_sec || now.tv_nsec != path_mtimes[i].tv_nsec)
+        {
+            path_mtimes[i] = now;
+            changed = 1;
+        }
+    }
+    return changed;
+}
+
+/* Wyszukanie polecenia w PATH z użyciem pamięci podręcznej; NULL, gdy brak */
+char *path_lookup(char *name)
+{
+    struct path_entry *e;
+    struct stat st;
+    char *path = NULL;
+    unsigned b = path_bucket(name);
+    int i;
+
+    path_cache_sync();
+    for (e = path_table[b]; e != NULL; e = e->next)
+    {
+        if (strcmp(e->name, name) == 0) break;
+    }
+    if (e != NULL)
+    {
+        if (!path_dirs_changed(e->dir))
+        {
+            e->hits++;
+            return e->path;
+        }
+        path_cache_clear();
+        path_dirs_changed(path_ndirs - 1);
+    }
+
+    for (i = 0; i < path_ndirs; i++)
+    {
+        path = path_join(path_dirs[i], name);
+        if (path == NULL) return NULL;
+        if (stat(path, &st) == 0 && S_ISREG(st.st_mode) && access(path, X_OK) == 0) break;
+        free(path);
+    }
+    if (i == path_ndirs) return NULL;
+
+    e = malloc(sizeof(*e));
+    if (e == NULL || (e->name = strdup(name)) == NULL)
+    {
+        free(e);
+        free(path);
+        return NULL;
+    }
+    e->path = path;
+    e->dir = i;
+    e->hits = 1;
+    e->next = path_table[b];
+    path_table[b] = e;
+    return e->path;
+}
+
+/* Funkcja hash: wyświetlenie (hash), opróżnienie (hash -r) lub dodanie poleceń */
+int builtin_hash(char **args)
+{
+    struct path_entry *e;
+    int i, shown = 0, rc = 0;
+
+    if (args[1] != NULL && strcmp(args[1], "-r") == 0)
+    {
+        path_cache_clear();
+        return 0;
+    }
+    if (args[1] != NULL)
+    {
+        for (i = 1; args[i] != NULL; i++)
+        {
+            if (strchr(args[i], '/') == NULL && path_lookup(args[i]) == NULL)
+            {
+                fprintf(stderr, "hash: %s: not found\n", args[i]);
+                rc = 1;
+            }
+        }
+        return rc;
+    }
+
+    for (i = 0; i < PATH_BUCKETS; i++)
+    {
+        for (e = path_table[i]; e != NULL; e = e->next)
+        {
+            if (!shown++) printf("hits\tcommand\n");
+            printf("%4d\t%s\n", e->hits, e->path);
+        }
+    }
+    if (!shown) printf("hash: hash table empty\n");
+    return 0;
+}
+
+/* Status zakończenia procesu w konwencji powłoki (sygnał: 128 + numer) */
+int exit_status(int status)
+{
+    if (WIFEXITED(status)) return WEXITSTATUS(status);
+    if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+    return 1;
+}
+
+/* Obsługa SIGCHLD i oczekiwanie: zebranie wszystkich zmian stanu dzieci bez blokowania
+   (tylko operacje bezpieczne w obsłudze sygnału) */
+void reap_children(void)
+{
+    pid_t pid;
+    int status, i, k;
+    int saved_errno = errno;
+
+    while ((pid = waitpid(-1, &status, WNOHANG | WUNTRACED | WCONTINUED)) > 0)
+    {
+        for (i = 0; i < JOBS_MAX; i++)
+        {
+            for (k = 0; job_table[i].id != 0 && k < job_table[i].count; k++)
+            {
+                if (job_table[i].pids[k] != pid) continue;
+                if (WIFSTOPPED(status)) job_table[i].states[k] = PROC_STOPPED;
+                else if (WIFCONTINUED(status)) job_table[i].states[k] = PROC_RUNNING;
+                else
+                {
+                    job_table[i].states[k] = PROC_DONE;
+                    job_table[i].statuses[k] = exit_status(status);
+                }
+            }
+        }
+    }
+    errno = saved_errno;
+}
+
+void sigchld_handler(int signum)
+{
+    (void)signum;
+    reap_children();
+}
+
+/* Blokada SIGCHLD na czas uruchamiania i rejestrowania zadania (dziecko nie zostanie
+   zebrane, zanim trafi do tablicy) */
+void sigchld_block(sigset_t *prev)
+{
+    sigset_t chld;
+
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld, prev);
+}
+
+/* Stan zadania: PROC_RUNNING, gdy działa choć jeden proces, PROC_STOPPED, gdy pozostałe
+   są zatrzymane, PROC_DONE po zakończeniu wszystkich */
+int job_state(const struct job *j)
+{
+    int k, state = PROC_DONE;
+
+    for (k = 0; k < j->count; k++)
+    {
+        if (j->states[k] == PROC_RUNNING) return PROC_RUNNING;
+        if (j->states[k] == PROC_STOPPED) state = PROC_STOPPED;
+    }
+    return state;
+}
+
+/* Status zadania: ostatniego procesu, z pipefail ostatni niezerowy */
+int job_status(const struct job *j)
+{
+    int k, result = 0;
+
+    for (k = 0; k < j->count; k++)
+    {
+        if (opt_pipefail ? j->statuses[k] != 0 : k == j->count - 1) result = j->statuses[k];
+    }
+    return result;
+}
+
+/* Zadanie bieżące (+, najnowsze) lub poprzednie (-) */
+struct job *job_current(int previous)
+{
+    struct job *best = NULL, *second = NULL;
+    int i;
+
+    for (i = 0; i < JOBS_MAX; i++)
+    {
+        if (job_table[i].id == 0) continue;
+        if (best == NULL || job_table[i].id > best->id)
+        {
+            second = best;
+            best = &job_table[i];
+        }
+        else if (second == NULL || job_table[i].id > second->id) second = &job_table[i];
+    }
+    return previous ? second : best;
+}
+
+/* Zwolnienie pozycji w tablicy zadań; wywoływane przy zablokowanym SIGCHLD (obsługa
+   sygnału przegląda pids) */
+void job_free(struct job *j)
+{
+    free(j->pids);
+    free((void *)j->states);
+    free((void *)j->statuses);
+    free(j->command);
+    memset(j, 0, sizeof(*j));
+}
+
+/* Rejestracja zadania; wywoływane przy zablokowanym SIGCHLD. pids[k] == -1 oznacza
+   etap, którego nie udało się uruchomić (status 127) */
+struct job *job_add(pid_t *pids, int count, const char *command)
+{
+    struct job *j = NULL, *last = job_current(0);
+    int i, k;
+
+    for (i = 0; i < JOBS_MAX && j == NULL; i++)
+    {
+        if (job_table[i].id == 0) j = &job_table[i];
+    }
+    if (j == NULL)
+    {
+        fprintf(stderr, "too many jobs\n");
+        return NULL;
+    }
+    j->pids = malloc(count * sizeof(*j->pids));
+    j->states = malloc(count * sizeof(*j->states));
+    j->statuses = malloc(count * sizeof(*j->statuses));
+    j->command = strdup(command);
+    if (j->pids == NULL || j->states == NULL || j->statuses == NULL || j->command == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        job_free(j);
+        return NULL;
+    }
+    j->count = count;
+    j->pgid = 0;
+    for (k = 0; k < count; k++)
+    {
+        j->pids[k] = pids[k];
+        j->states[k] = pids[k] == -1 ? PROC_DONE : PROC_RUNNING;
+        j->statuses[k] = 127;
+        if (j->pgid == 0 && pids[k] != -1 && job_control) j->pgid = pids[k];
+    }
+    j->id = last != NULL ? last->id + 1 : 1;
+    return j;
+}
+
+/* Wysłanie sygnału do całego zadania (grupa procesów albo kolejne procesy) */
+void job_signal(const struct job *j, int sig)
+{
+    int k;
+
+    if (j->pgid > 0)
+    {
+        kill(-j->pgid, sig);
+        return;
+    }
+    for (k = 0; k < j->count; k++)
+    {
+        if (j->states[k] != PROC_DONE) kill(j->pids[k], sig);
+    }
+}
+
+/* Oczekiwanie, aż zadanie przestanie działać (zakończy się lub zostanie zatrzymane);
+   interruptible (wait): CTRL+C kończy czekanie z wynikiem -1 */
+int job_wait(struct job *j, int interruptible)
+{
+    sigset_t prev, wait_mask, intr;
+    int rc = 0;
+
+    sigchld_block(&prev);
+    /* SIGINT zablokowany między sprawdzeniem flagi a sigsuspend, żeby nie przepadł */
+    sigemptyset(&intr);
+    sigaddset(&intr, SIGINT);
+    if (interruptible) sigprocmask(SIG_BLOCK, &intr, NULL);
+    wait_mask = prev;
+    sigdelset(&wait_mask, SIGCHLD);
+    if (interruptible) sigdelset(&wait_mask, SIGINT);
+    for (;;)
+    {
+        reap_children();
+        if (job_state(j) != PROC_RUNNING) break;
+        if (interruptible && interrupted)
+        {
+            rc = -1;
+            break;
+        }
+        sigsuspend(&wait_mask);
+    }
+    sigprocmask(SIG_SETMASK, &prev, NULL);
+    return rc;
+}
+
+/* Zadanie na pierwszym planie: terminal dla jego grupy, oczekiwanie, powrót terminala
+   do powłoki; zatrzymane zadanie (CTRL+Z) zostaje w tablicy, zakończone jest zwalniane */
+int job_foreground(struct job *j, int resume)
+{
+    int status;
+
+    if (job_control && j->pgid > 0) tcsetpgrp(STDIN_FILENO, j->pgid);
+    if (resume) job_signal(j, SIGCONT);
+    job_wait(j, 0);
+    if (job_control) tcsetpgrp(STDIN_FILENO, shell_pgid);
+
+    if (job_state(j) == PROC_STOPPED)
     {
-        perror("cp: source error");
-        return;
+        printf("\n[%d]+  Stopped                 %s\n", j->id, j->command);
+        return 128 + SIGTSTP;
+    }
+    status = job_status(j);
+    /* CTRL+C trafił tylko do zadania, więc znak zachęty przenosi powłoka */
+    if (job_control && status == 128 + SIGINT) printf("\n");
+    job_free(j);
+    return status;
+}
+
+/* Opis stanu zadania dla jobs i powiadomień */
+void job_print(const struct job *j)
+{
+    char state[32];
+    int status;
+    const struct job *current = job_current(0), *previous = job_current(1);
+
+    if (job_state(j) == PROC_RUNNING) strcpy(state, "Running");
+    else if (job_state(j) == PROC_STOPPED) strcpy(state, "Stopped");
+    else if ((status = job_status(j)) == 0) strcpy(state, "Done");
+    else sprintf(state, "Exit %d", status);
+    printf("[%d]%c  %-24s%s\n", j->id, j == current ? '+' : j == previous ? '-' : ' ', state, j->command);
+}
+
+/* Powiadomienia przed znakiem zachęty: zakończone zadania w tle */
+void jobs_notify(void)
+{
+    sigset_t prev;
+    int i;
+
+    sigchld_block(&prev);
+    for (i = 0; i < JOBS_MAX; i++)
+    {
+        if (job_table[i].id != 0 && job_state(&job_table[i]) == PROC_DONE)
+        {
+            job_print(&job_table[i]);
+            job_free(&job_table[i]);
+        }
+    }
+    sigprocmask(SIG_SETMASK, &prev, NULL);
+}
+
+/* Uruchomione procesy jako zadanie: w tle wypisanie [n] pid, na pierwszym planie
+   oczekiwanie i status; wywoływane przy zablokowanym SIGCHLD */
+int job_launch(pid_t *pids, int count, const char *command, int background)
+{
+    struct job *j = job_add(pids, count, command);
+
+    if (j == NULL)
+    {
+        return 1;
+    }
+    if (background)
+    {
+        printf("[%d] %d\n", j->id, (int)pids[count - 1]);
+        fflush(stdout);
+        return 0;
+    }
+    return job_foreground(j, 0);
+}
+
+/* Wskazanie zadania: %n, %+, %%, %-, PID albo brak argumentu (zadanie bieżące) */
+struct job *job_find(const char *spec)
+{
+    int i, k, id;
+
+    if (spec == NULL || strcmp(spec, "%%") == 0 || strcmp(spec, "%+") == 0) return job_current(0);
+    if (strcmp(spec, "%-") == 0) return job_current(1);
+    id = atoi(spec[0] == '%' ? spec + 1 : spec);
+    for (i = 0; id > 0 && i < JOBS_MAX; i++)
+    {
+        if (job_table[i].id == 0) continue;
+        if (spec[0] == '%' && job_table[i].id == id) return &job_table[i];
+        for (k = 0; spec[0] != '%' && k < job_table[i].count; k++)
+        {
+            if (job_table[i].pids[k] == id) return &job_table[i];
+        }
+    }
+    return NULL;
+}
+
+/* Funkcja jobs: lista zadań (zakończone są wypisywane po raz ostatni) */
+int builtin_jobs(char **args)
+{
+    sigset_t prev;
+    int i;
+
+    (void)args;
+    sigchld_block(&prev);
+    reap_children();
+    for (i = 0; i < JOBS_MAX; i++)
+    {
+        if (job_table[i].id != 0) job_print(&job_table[i]);
+    }
+    for (i = 0; i < JOBS_MAX; i++)
+    {
+        if (job_table[i].id != 0 && job_state(&job_table[i]) == PROC_DONE) job_free(&job_table[i]);
+    }
+    sigprocmask(SIG_SETMASK, &prev, NULL);
+    return 0;
+}
+
+/* Funkcja fg: zadanie na pierwszy plan (wznowienie, jeśli zatrzymane); status zadania */
+int builtin_fg(char **args)
+{
+    struct job *j;
+    sigset_t prev;
+    int status;
+
+    sigchld_block(&prev);
+    j = job_find(args[1]);
+    if (j == NULL)
+    {
+        sigprocmask(SIG_SETMASK, &prev, NULL);
+        fprintf(stderr, "fg: %s: no such job\n", args[1] != NULL ? args[1] : "current");
+        return 1;
+    }
+    printf("%s\n", j->command);
+    fflush(stdout);
+    status = job_foreground(j, 1);
+    sigprocmask(SIG_SETMASK, &prev, NULL);
+    return status;
+}
+
+/* Funkcja bg: wznowienie zatrzymanego zadania w tle */
+int builtin_bg(char **args)
+{
+    struct job *j = job_find(args[1]);
+
+    if (j == NULL)
+    {
+        fprintf(stderr, "bg: %s: no such job\n", args[1] != NULL ? args[1] : "current");
+        return 1;
+    }
+    printf("[%d]+ %s &\n", j->id, j->command);
+    job_signal(j, SIGCONT);
+    return 0;
+}
+
+/* Funkcja wait: oczekiwanie na wskazane zadanie albo na wszystkie zadania w tle;
+   status ostatniego wskazanego zadania (127, gdy go nie ma, 130 po CTRL+C) */
+int builtin_wait(char **args)
+{
+    struct job *j;
+    sigset_t prev;
+    int i, status = 0;
+
+    /* job_wait odblokowuje SIGCHLD tylko na czas sigsuspend */
+    sigchld_block(&prev);
+    if (args[1] == NULL)
+    {
+        for (i = 0; i < JOBS_MAX; i++)
+        {
+            if (job_table[i].id == 0 || job_state(&job_table[i]) == PROC_STOPPED) continue;
+            if (job_wait(&job_table[i], 1) == -1)
+            {
+                status = 128 + SIGINT;
+                break;
+            }
+            if (job_state(&job_table[i]) == PROC_DONE) job_free(&job_table[i]);
+        }
+        sigprocmask(SIG_SETMASK, &prev, NULL);
+        return status;
+    }
+    for (i = 1; args[i] != NULL; i++)
+    {
+        j = job_find(args[i]);
+        if (j == NULL)
+        {
+            fprintf(stderr, "wait: %s: no such job\n", args[i]);
+            status = 127;
+            continue;
+        }
+        if (job_wait(j, 1) == -1)
+        {
+            status = 128 + SIGINT;
+            break;
+        }
+        status = job_state(j) == PROC_DONE ? job_status(j) : 128 + SIGTSTP;
+        if (job_state(j) == PROC_DONE) job_free(j);
+    }
+    sigprocmask(SIG_SETMASK, &prev, NULL);
+    return status;
+}
+
+/* Uruchomienie programu zewnętrznego: posix_spawn() ze ścieżką z pamięci hash
+   (glibc: clone(CLONE_VM | CLONE_VFORK), bez kopiowania tablic stron powłoki);
+   in_fd/out_fd (-1: bez zmian) trafiają na stdin/stdout dziecka, a przekierowania
+   r (może być NULL) są otwierane dopiero w dziecku, po podłączeniu potoku;
+   pgid: -1 - bez zmiany grupy, 0 - nowa grupa procesów, inaczej dołączenie do pgid */
+pid_t spawn_external(char **args, int in_fd, int out_fd, const struct redirects *r, pid_t pgid)
+{
+    pid_t pid;
+    int rc, i;
+    char *path;
+    char **sh_args;
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_t actions;
+    sigset_t sigdefault, sigmask;
+
+    /* W dziecku SIGINT i sygnały kontroli zadań wracają do domyślnej obsługi,
+       maska sygnałów pusta (powłoka blokuje SIGCHLD na czas uruchamiania) */
+    posix_spawnattr_init(&attr);
+    sigemptyset(&sigdefault);
+    sigaddset(&sigdefault, SIGINT);
+    sigaddset(&sigdefault, SIGQUIT);
+    sigaddset(&sigdefault, SIGTSTP);
+    sigaddset(&sigdefault, SIGTTIN);
+    sigaddset(&sigdefault, SIGTTOU);
+    sigemptyset(&sigmask);
+    posix_spawnattr_setsigdefault(&attr, &sigdefault);
+    posix_spawnattr_setsigmask(&attr, &sigmask);
+    if (pgid >= 0) posix_spawnattr_setpgroup(&attr, pgid);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK |
+                                    (pgid >= 0 ? POSIX_SPAWN_SETPGROUP : 0));
+
+    posix_spawn_file_actions_init(&actions);
+    if (in_fd != -1) posix_spawn_file_actions_adddup2(&actions, in_fd, STDIN_FILENO);
+    if (out_fd != -1) posix_spawn_file_actions_adddup2(&actions, out_fd, STDOUT_FILENO);
+    for (i = 0; r != NULL && i < r->count; i++)
+    {
+        if (r->list[i].path != NULL)
+            posix_spawn_file_actions_addopen(&actions, r->list[i].fd, r->list[i].path, r->list[i].flags, 0666);
+        else
+            posix_spawn_file_actions_adddup2(&actions, r->list[i].dup_fd, r->list[i].fd);
+    }
+
+    path = strchr(args[0], '/') != NULL ? args[0] : path_lookup(args[0]);
+    rc = path != NULL ? posix_spawn(&pid, path, &actions, &attr, args, environ) : ENOENT;
+    /* Plik wykonywalny bez #! (ENOEXEC): jak execvp, skrypt dla /bin/sh */
+    if (rc == ENOEXEC)
+    {
+        for (i = 0; args[i] != NULL; i++);
+        sh_args = arena_alloc(&cmd_arena, (i + 2) * sizeof(*sh_args));
+        sh_args[0] = "/bin/sh";
+        sh_args[1] = path;
+        memcpy(sh_args + 2, args + 1, i * sizeof(*sh_args));
+        rc = posix_spawn(&pid, "/bin/sh", &actions, &attr, sh_args, environ);
+    }
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+
+    if (rc != 0)
+    {
+        /* Błąd otwarcia pliku przekierowania też wraca jako kod posix_spawn():
+           program jest wykonywalny, więc winny jest pierwszy niedostępny plik */
+        for (i = 0; path != NULL && r != NULL && i < r->count && access(path, X_OK) == 0; i++)
+        {
+            if (r->list[i].path != NULL &&
+                access(r->list[i].path, r->list[i].flags == O_RDONLY ? R_OK : W_OK) == -1)
+            {
+                fprintf(stderr, "%s: %s\n", r->list[i].path, strerror(rc));
+                return -1;
+            }
+        }
+        fprintf(stderr, "%s: %s\n", args[0], strerror(rc));
+        return -1;
+    }
+    return pid;
+}
+
+/* Funkcja procesów potomnych i zewnętrznych programów; zwraca status zakończenia */
+int execute_external(char **args, const struct redirects *r, const char *command)
+{
+    sigset_t prev;
+    pid_t pid;
+    int status;
+
+    sigchld_block(&prev);
+    pid = spawn_external(args, -1, -1, r, job_control ? 0 : -1);
+    status = pid == -1 ? 127 : job_launch(&pid, 1, command, 0);
+    sigprocmask(SIG_SETMASK, &prev, NULL);
+    return status;
+}
+
+/* Funkcja set: opcje powłoki (set -o OPCJA / set +o OPCJA) */
+int builtin_set(char **args)
+{
+    static const char *names[] = { "pipefail", "bigpipe" };
+    int *values[2];
+    int i;
+
+    values[0] = &opt_pipefail;
+    values[1] = &opt_bigpipe;
+
+    if (args[1] == NULL)
+    {
+        for (i = 0; i < 2; i++) printf("%s\t%s\n", names[i], *values[i] ? "on" : "off");
+        return 0;
+    }
+    if ((strcmp(args[1], "-o") == 0 || strcmp(args[1], "+o") == 0) && args[2] != NULL)
+    {
+        for (i = 0; i < 2; i++)
+        {
+            if (strcmp(args[2], names[i]) == 0)
+            {
+                *values[i] = args[1][0] == '-';
+                return 0;
+            }
+        }
+    }
+    fprintf(stderr, "set: usage: set [-o|+o pipefail|bigpipe]\n");
+    return 2;
+}
+
+/* Przeniesienie całej zawartości in_fd do out_fd od bieżących pozycji: splice (jedna
+   ze stron jest potokiem), copy_file_range (plik -> plik, np. cat a > b), sendfile,
+   w ostateczności read/write */
+int cat_fd(int in_fd, int out_fd)
+{
+    char *buffer;
+    ssize_t n, written, done;
+    struct stat in_st, out_st;
+    int method = CP_SPLICE;
+    int moved = 0;
+
+    /* copy_file_range tylko dla zwykłych plików o znanym rozmiarze (/proc zwraca 0) */
+    if (fstat(in_fd, &in_st) == 0 && fstat(out_fd, &out_st) == 0 &&
+        S_ISREG(in_st.st_mode) && S_ISREG(out_st.st_mode) && in_st.st_size > 0)
+        method = CP_COPY_FILE_RANGE;
+
+    for (;;)
+    {
+        if (interrupted)
+        {
+            errno = EINTR;
+            return -1;
+        }
+        if (method == CP_SPLICE) n = splice(in_fd, NULL, out_fd, NULL, PIPE_BIG_SIZE, SPLICE_F_MOVE | SPLICE_F_MORE);
+        else if (method == CP_COPY_FILE_RANGE) n = copy_file_range(in_fd, NULL, out_fd, NULL, PIPE_BIG_SIZE, 0);
+        else if (method == CP_SENDFILE) n = sendfile(out_fd, in_fd, NULL, PIPE_BIG_SIZE);
+        else break;
+        if (n == 0) return 0;
+        if (n > 0)
+        {
+            moved = 1;
+            continue;
+        }
+        if (errno == EINTR) continue;
+        /* EBADF z copy_file_range: cel otwarty z O_APPEND (>>) */
+        if (moved || !(cp_unsupported(errno) || (method == CP_COPY_FILE_RANGE && errno == EBADF))) return -1;
+        method = method == CP_SENDFILE ? CP_READ_WRITE : CP_SENDFILE;
+    }
+
+    buffer = cp_get_buffer(FILE_BUF_SIZE);
+    if (buffer == NULL) return -1;
+    for (;;)
+    {
+        if (interrupted)
+        {
+            errno = EINTR;
+            return -1;
+        }
+        n = read(in_fd, buffer, FILE_BUF_SIZE);
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) return (int)n;
+        for (done = 0; done < n; done += written)
+        {
+            written = write(out_fd, buffer + done, n - done);
+            if (written == -1 && errno == EINTR) written = 0;
+            else if (written == -1) return -1;
+        }
+    }
+}
+
+/* Funkcja cat: wypisanie plików (bez argumentów - standardowe wejście) */
+int builtin_cat(char **args)
+{
+    struct stat in_st, out_st;
+    int i, fd, out_reg, rc = 0;
+
+    out_reg = fstat(STDOUT_FILENO, &out_st) == 0 && S_ISREG(out_st.st_mode);
+    if (args[1] == NULL && cat_fd(STDIN_FILENO, STDOUT_FILENO) == -1)
+    {
+        perror("cat");
+        rc = 1;
+    }
+    for (i = 1; args[i] != NULL; i++)
+    {
+        fd = strcmp(args[i], "-") == 0 ? STDIN_FILENO : open(args[i], O_RDONLY | O_CLOEXEC);
+        if (fd == -1)
+        {
+            fprintf(stderr, "cat: %s: %s\n", args[i], strerror(errno));
+            rc = 1;
+            continue;
+        }
+        /* cat a >> a rosłoby bez końca */
+        if (out_reg && fstat(fd, &in_st) == 0 && in_st.st_dev == out_st.st_dev && in_st.st_ino == out_st.st_ino)
+        {
+            fprintf(stderr, "cat: %s: input file is output file\n", args[i]);
+            rc = 1;
+        }
+        else if (cat_fd(fd, STDOUT_FILENO) == -1)
+        {
+            fprintf(stderr, "cat: %s: %s\n", args[i], strerror(errno));
+            rc = 1;
+        }
+        if (fd != STDIN_FILENO) close(fd);
+        if (interrupted) break;
+    }
+    return rc;
+}
+
+/* Funkcje true i false: tylko status (do list && i ||) */
+int builtin_true(char **args)
+{
+    (void)args;
+    return 0;
+}
+
+int builtin_false(char **args)
+{
+    (void)args;
+    return 1;
+}
+
+/* Tabela poleceń wbudowanych, posortowana według nazwy (wyszukiwanie binarne) */
+const struct builtin builtins[] =
+{
+    { "bg",      builtin_bg,      0,       BI_GROUP_EXTRA, "bg [%job]", "wznowić zadanie w tle" },
+    { "cat",     builtin_cat,     BI_NO_OPTIONS, BI_GROUP_OWN, "cat [FILE...]", "wypisać zawartość plików" },
+    { "cd",      builtin_cd,      0,       BI_GROUP_CORE,  "cd [path]", "zmienić katalog" },
+    { "clear",   builtin_clear,   0,       BI_GROUP_EXTRA, "clear", "wyczyścić ekran" },
+    { "cp",      builtin_cp,      0,       BI_GROUP_OWN,
+      "cp [-ruv] [--reflink=auto|always|never] [--bs=SIZE] [--direct] [--update|--checksum] [--verify] [--progress] [--resume] SRC DST...",
+      "kopiować pliki i katalogi" },
+    { "exit",    NULL,            BI_EXIT, BI_GROUP_CORE,  "exit [n]", "wyjść z programu" },
+    { "false",   builtin_false,   0,       BI_GROUP_EXTRA, "false", "status 1" },
+    { "fg",      builtin_fg,      0,       BI_GROUP_EXTRA, "fg [%job]", "zadanie na pierwszy plan" },
+    { "hash",    builtin_hash,    0,       BI_GROUP_EXTRA, "hash [-r] [name...]", "pamięć ścieżek poleceń" },
+    { "help",    builtin_help,    0,       BI_GROUP_CORE,  "help", "wyświetlić ten komunikat" },
+    { "history", builtin_history, 0,       BI_GROUP_EXTRA, "history", "wyświetlić historię poleceń" },
+    { "jobs",    builtin_jobs,    0,       BI_GROUP_EXTRA, "jobs", "wyświetlić zadania w tle" },
+    { "set",     builtin_set,     0,       BI_GROUP_CORE,  "set [-o|+o pipefail|bigpipe]", "opcje powłoki" },
+    { "stat",    builtin_stat,    0,       BI_GROUP_OWN,   "stat FILE", "wyświetlić informacje o pliku" },
+    { "touch",   builtin_touch,   0,       BI_GROUP_OWN,   "touch FILE", "utworzyć plik lub zmienić jego czas" },
+    { "true",    builtin_true,    0,       BI_GROUP_EXTRA, "true", "status 0" },
+    { "wait",    builtin_wait,    0,       BI_GROUP_EXTRA, "wait [%job|pid...]", "czekać na zadania w tle" }
+};
+
+const size_t builtin_count = sizeof(builtins) / sizeof(builtins[0]);
+
+/* Porównanie nazwy z wpisem tabeli dla bsearch() */
+int builtin_compare(const void *key, const void *entry)
+{
+    return strcmp((const char *)key, ((const struct builtin *)entry)->name);
+}
+
+/* Wyszukanie polecenia wbudowanego; NULL dla programów zewnętrznych */
+const struct builtin *find_builtin(const char *name)
+{
+    return bsearch(name, builtins, builtin_count, sizeof(builtins[0]), builtin_compare);
+}
+
+/* Polecenie wbudowane dla całego argv: wersja bez opcji (BI_NO_OPTIONS) ustępuje
+   programowi zewnętrznemu, gdy któryś argument jest opcją (cat -n; samo - to plik) */
+const struct builtin *command_builtin(char **argv)
+{
+    const struct builtin *b = find_builtin(argv[0]);
+    int i;
+
+    for (i = 1; b != NULL && (b->flags & BI_NO_OPTIONS) && argv[i] != NULL; i++)
+    {
+        if (argv[i][0] == '-' && argv[i][1] != '\0') return NULL;
+    }
+    return b;
+}
+
+/* Status dla exit [n]: n modulo 256, bez argumentu status ostatniego polecenia */
+int exit_code(char **args, int fallback)
+{
+    char *end;
+    long n;
+
+    if (args[1] == NULL) return fallback;
+    errno = 0;
+    n = strtol(args[1], &end, 10);
+    if (errno != 0 || end == args[1] || *end != '\0')
+    {
+        fprintf(stderr, "exit: %s: numeric argument required\n", args[1]);
+        return 2;
+    }
+    return (int)(n & 0xFF);
+}
+
+/* Pierwszy znacznik $? słowa word (indeks w params) albo params->count, gdy brak.
+   Słowa leżą w buforze linii w kolejności parsowania, tak samo znaczniki, więc przy
+   słowach podawanych po kolei *cursor tylko rośnie i całe polecenie kosztuje liniowo */
+int param_first(const struct param_marks *params, const char *word, int *cursor)
+{
+    while (*cursor < params->count && params->list[*cursor].word < word) (*cursor)++;
+    return *cursor < params->count && params->list[*cursor].word == word ? *cursor : params->count;
+}
+
+/* Rozwinięcie $? w jednym słowie w momencie wykonania (wynik w arenie polecenia);
+   słowo bez znaczników jest zwracane bez kopiowania; cursor jak w param_first */
+char *expand_word(const struct param_marks *params, const char *word, int *cursor)
+{
+    char status[16];
+    char *out, *w;
+    size_t len, done = 0;
+    int first = param_first(params, word, cursor), i;
+
+    if (first == params->count) return (char *)word;
+    len = strlen(word);
+
+    sprintf(status, "%d", last_status);
+    for (i = first; i < params->count && params->list[i].word == word; i++);
+    out = w = arena_alloc(&cmd_arena, len + (i - first) * strlen(status) + 1);
+    for (i = first; i < params->count && params->list[i].word == word; i++)
+    {
+        memcpy(w, word + done, params->list[i].offset - done);
+        w += params->list[i].offset - done;
+        done = params->list[i].offset;
+        w += sprintf(w, "%s", status);
+    }
+    memcpy(w, word + done, len - done + 1);
+    return out;
+}
+
+/* Rozwinięcie $? w argumentach; bez znaczników w linii (zwykle) argv bez kopiowania */
+char **expand_argv(const struct param_marks *params, char **argv)
+{
+    char **out;
+    int i, n, cursor = 0;
+
+    if (params->count == 0) return argv;
+    for (n = 0; argv[n] != NULL; n++);
+    out = arena_alloc(&cmd_arena, (n + 1) * sizeof(*out));
+    for (i = 0; i < n; i++) out[i] = expand_word(params, argv[i], &cursor);
+    out[n] = NULL;
+    return out;
+}
+
+/* Rozwinięcie $? w ścieżkach przekierowań (echo x > out$?): kopia w *copy albo r bez zmian */
+const struct redirects *expand_redirects(const struct param_marks *params, const struct redirects *r,
+                                         struct redirects *copy)
+{
+    int i, cursor = 0;
+
+    if (params->count == 0) return r;
+    *copy = *r;
+    for (i = 0; i < r->count; i++)
+    {
+        if (r->list[i].path != NULL) copy->list[i].path = expand_word(params, r->list[i].path, &cursor);
+    }
+    return copy;
+}
+
+/* Proces potomny powłoki: domyślna obsługa sygnałów terminala, pusta maska */
+void child_signals(void)
+{
+    sigset_t none;
+
+    signal(SIGINT, SIG_DFL);
+    signal(SIGQUIT, SIG_DFL);
+    signal(SIGTSTP, SIG_DFL);
+    signal(SIGTTIN, SIG_DFL);
+    signal(SIGTTOU, SIG_DFL);
+    sigemptyset(&none);
+    sigprocmask(SIG_SETMASK, &none, NULL);
+}
+
+/* Polecenie wbudowane jako etap potoku: wykonanie w procesie potomnym */
+pid_t fork_builtin(const struct builtin *b, char **args, int in_fd, int out_fd, const struct redirects *r, pid_t pgid)
+{
+    pid_t pid;
+    int status;
+
+    fflush(stdout);
+    pid = fork();
+    if (pid == 0)
+    {
+        if (pgid >= 0) setpgid(0, pgid);
+        signal(SIGCHLD, SIG_DFL);
+        child_signals();
+        if (in_fd != -1) dup2(in_fd, STDIN_FILENO);
+        if (out_fd != -1) dup2(out_fd, STDOUT_FILENO);
+        if (apply_redirects(r, NULL) == -1) _exit(EXIT_FAILURE);
+        status = b->handler != NULL ? b->handler(args) : exit_code(args, last_status);
+        fflush(stdout);
+        _exit(status);
+    }
+    if (pid < 0) perror("fork failed");
+    /* Także w rodzicu: grupa istnieje, zanim kolejny etap zechce do niej dołączyć */
+    else if (pgid >= 0) setpgid(pid, pgid == 0 ? pid : pgid);
+    return pid;
+}
+
+/* Największy rozmiar bufora potoku dopuszczalny dla procesu bez uprawnień
+   (/proc/sys/fs/pipe-max-size), odczytywany raz */
+int pipe_max_size(void)
+{
+    static int size = 0;
+    FILE *f;
+
+    if (size > 0) return size;
+    size = PIPE_BIG_SIZE;
+    f = fopen("/proc/sys/fs/pipe-max-size", "r");
+    if (f != NULL)
+    {
+        if (fscanf(f, "%d", &size) != 1 || size <= 0) size = PIPE_BIG_SIZE;
+        fclose(f);
+    }
+    return size;
+}
+
+/* Potok cmd1 | cmd2 | ...: wszystkie etapy startują od razu w jednej grupie procesów
+   i tworzą jedno zadanie; status z ostatniego (z pipefail: ostatni niezerowy) */
+int execute_pipeline(const struct ast_pipeline *pl, int background)
+{
+    const struct ast_command *cmd;
+    const struct builtin *b;
+    const struct redirects *r;
+    struct redirects redirs;
+    char **argv;
+    pid_t *pids;
+    sigset_t prev;
+    pid_t pgid = job_control ? 0 : -1;
+    int fds[2];
+    int in_fd = -1;
+    int n = pl->count, k, result;
+
+    pids = arena_alloc(&cmd_arena, n * sizeof(*pids));
+    sigchld_block(&prev);
+    for (k = 0; k < n; k++)
+    {
+        cmd = &pl->commands[k];
+        fds[0] = fds[1] = -1;
+        if (k < n - 1 && pipe2(fds, O_CLOEXEC) == -1)
+        {
+            perror("pipe");
+            n = k;
+            break;
+        }
+        if (fds[1] != -1 && opt_bigpipe) fcntl(fds[1], F_SETPIPE_SZ, pipe_max_size());
+        pids[k] = -1;
+        if (cmd->argv[0] != NULL)
+        {
+            argv = expand_argv(cmd->params, cmd->argv);
+            r = expand_redirects(cmd->params, &cmd->redirs, &redirs);
+            b = command_builtin(argv);
+            pids[k] = b != NULL ? fork_builtin(b, argv, in_fd, fds[1], r, pgid)
+                                : spawn_external(argv, in_fd, fds[1], r, pgid);
+            if (pgid == 0 && pids[k] != -1) pgid = pids[k];
+        }
+        if (in_fd != -1) close(in_fd);
+        if (fds[1] != -1) close(fds[1]);
+        in_fd = fds[0];
+    }
+    if (in_fd != -1) close(in_fd);
+
+    result = n > 0 ? job_launch(pids, n, pl->text, background) : 1;
+    sigprocmask(SIG_SETMASK, &prev, NULL);
+    return result;
+}
+
+/* Tekst polecenia dla tablicy zadań (tokeny oddzielone spacją, $? z powrotem jako "$?");
+   out ma miejsce na wszystkie tokeny i znaczniki */
+void command_text(char **args, const struct param_marks *params, char *out)
+{
+    size_t len = 0, k, n;
+    int i, m, cursor = 0;
+
+    out[0] = '\0';
+    for (i = 0; args[i] != NULL; i++)
+    {
+        if (i > 0) out[len++] = ' ';
+        /* Operatory są stałymi poza buforem linii i nie mają znaczników */
+        if (args[i] == op_pipe || is_redirect_op(args[i])) m = params->count;
+        else m = param_first(params, args[i], &cursor);
+        n = strlen(args[i]);
+        for (k = 0; k <= n; k++)
+        {
+            for (; m < params->count && params->list[m].word == args[i] && params->list[m].offset == k; m++)
+            {
+                out[len++] = '$';
+                out[len++] = '?';
+            }
+            if (k < n) out[len++] = args[i][k];
+        }
+        out[len] = '\0';
+    }
+}
+
+/* Budowa potoku z tokenów (bez operatorów list): etapy rozdzielone |, przekierowania
+   wydzielone z argumentów; -1 przy błędzie składni */
+int ast_pipeline(struct ast_pipeline *pl, char **tokens, const struct param_marks *params, struct arena *a)
+{
+    size_t size = 2 * params->count + 1;
+    int i, k, start;
+
+    for (i = 0; tokens[i] != NULL; i++) size += strlen(tokens[i]) + 1;
+    pl->text = arena_alloc(a, size);
+    command_text(tokens, params, pl->text);
+
+    pl->count = 1;
+    for (i = 0; tokens[i] != NULL; i++)
+    {
+        if (tokens[i] == op_pipe) pl->count++;
+    }
+    pl->commands = arena_alloc(a, pl->count * sizeof(*pl->commands));
+
+    for (k = 0, start = 0, i = 0; k < pl->count; i++)
+    {
+        if (tokens[i] != NULL && tokens[i] != op_pipe) continue;
+        if (i == start)
+        {
+            fprintf(stderr, "syntax error near unexpected token '|'\n");
+            return -1;
+        }
+        if (tokens[i] != NULL) tokens[i] = NULL;
+        pl->commands[k].argv = &tokens[start];
+        pl->commands[k].params = params;
+        if (collect_redirects(pl->commands[k].argv, &pl->commands[k].redirs) == -1) return -1;
+        k++;
+        start = i + 1;
     }
+    return 0;
+}
 
-    dst_fd = open(args[2], O_WRONLY | O_CREAT | O_TRUNC, src_stat.st_mode);
-    if (dst_fd == -1)
+/* Budowa drzewa z tokenów i znaczników $? z parse_command(); wszystko w arenie a, NULL
+   przy błędzie składni. Końcowe ; lub & są dozwolone, końcowe && || nie */
+struct ast *ast_build(char **tokens, const struct param_marks *params, struct arena *a)
+{
+    struct ast *t = arena_alloc(a, sizeof(*t));
+    struct ast_pipeline *pl;
+    const char *tok;
+    int i, start = 0, count = 1;
+
+    t->params = *params;
+    for (i = 0; tokens[i] != NULL; i++)
     {
-        perror("cp: destination error");
-        close(src_fd);
-        return;
+        if (is_list_op(tokens[i])) count++;
     }
+    t->pipelines = arena_alloc(a, count * sizeof(*t->pipelines));
+    t->count = 0;
 
-    while ((n_read = read(src_fd, buffer, sizeof(buffer))) > 0)
+    for (i = 0; ; i++)
     {
-        if (write(dst_fd, buffer, n_read) != n_read)
+        tok = tokens[i];
+        if (tok != NULL && !is_list_op(tok)) continue;
+        if (i == start)
         {
-            perror("cp: write error");
-            close(src_fd);
-            close(dst_fd);
-            return;
+            if (tok == NULL && (t->count == 0 || t->pipelines[t->count - 1].connector == AST_SEQ ||
+                                t->pipelines[t->count - 1].connector == AST_BG)) break;
+            fprintf(stderr, "syntax error near unexpected token '%s'\n", tok != NULL ? tok : "newline");
+            return NULL;
         }
+        pl = &t->pipelines[t->count++];
+        pl->connector = tok == op_seq ? AST_SEQ : tok == op_and ? AST_AND :
+                        tok == op_or ? AST_OR : tok == op_bg ? AST_BG : AST_END;
+        tokens[i] = NULL;
+        if (ast_pipeline(pl, &tokens[start], &t->params, a) == -1) return NULL;
+        if (tok == NULL) break;
+        start = i + 1;
     }
+    return t;
+}
 
-    if (n_read == -1) perror("cp: read error");
-    
-    close(src_fd);
-    close(dst_fd);
+/* Pamięć podręczna drzew: skrót linii -> drzewo. Każdy wpis ma własną arenę (niezależną
+   od areny polecenia), zwalnianą przy zastąpieniu wpisu */
+struct ast_cache_entry
+{
+    uint64_t hash;
+    char *line;
+    struct ast *tree;
+    struct arena arena;
+};
+
+struct ast_cache_entry ast_cache[AST_CACHE_SIZE];
+
+/* Drzewo dla linii: z pamięci podręcznej albo parsowanie; długie linie (jednorazowe
+   skrypty) są parsowane w arenie polecenia i nie zajmują pamięci podręcznej */
+struct ast *ast_lookup(const char *line)
+{
+    size_t len = strlen(line);
+    uint64_t h = hash64_update(HASH_PRIME1, (const unsigned char *)line, len);
+    struct ast_cache_entry *e = &ast_cache[h % AST_CACHE_SIZE];
+    struct param_marks params;
+    char **tokens;
+    char *copy;
+
+    if (e->tree != NULL && e->hash == h && strcmp(e->line, line) == 0) return e->tree;
+
+    if (len > AST_CACHE_LINE_MAX)
+    {
+        copy = arena_alloc(&cmd_arena, len + 1);
+        memcpy(copy, line, len + 1);
+        tokens = parse_command(copy, &cmd_arena, &params);
+        return ast_build(tokens, &params, &cmd_arena);
+    }
+
+    arena_free(&e->arena);
+    e->line = arena_alloc(&e->arena, len + 1);
+    memcpy(e->line, line, len + 1);
+    copy = arena_alloc(&e->arena, len + 1);
+    memcpy(copy, line, len + 1);
+    e->hash = h;
+    tokens = parse_command(copy, &e->arena, &params);
+    e->tree = ast_build(tokens, &params, &e->arena);
+    if (e->tree == NULL) arena_free(&e->arena);
+    return e->tree;
 }
 
-/* Funkcja procesów potomnych i zewnętrznych programów: fork(), execvp() */
-void execute_external(char **args)
+/* Proste polecenie na pierwszym planie: wbudowane z podmianą deskryptorów w powłoce
+   (bez fork()), zewnętrzne przez posix_spawn() */
+int execute_simple(const struct ast_command *cmd, const char *text)
 {
-    pid_t pid;
+    const struct builtin *b;
+    const struct redirects *r;
+    struct redirects redirs;
+    int saved[MAX_REDIRS];
+    char **argv;
     int status;
 
-    pid = fork();
+    r = expand_redirects(cmd->params, &cmd->redirs, &redirs);
+    if (cmd->argv[0] == NULL)
+    {
+        /* Samo przekierowanie (> plik): utworzenie lub obcięcie pliku */
+        if (apply_redirects(r, saved) == -1) return 1;
+        restore_redirects(r, saved, r->count);
+        return 0;
+    }
 
-    if (pid == 0)
+    argv = expand_argv(cmd->params, cmd->argv);
+    b = command_builtin(argv);
+    if (b == NULL) return execute_external(argv, r, text);
+    if (b->flags & BI_EXIT)
     {
-        signal(SIGINT, SIG_DFL);
+        exit_requested = 1;
+        return exit_code(argv, last_status);
+    }
+    fflush(stdout);
+    if (apply_redirects(r, saved) == -1) return 1;
+    status = b->handler(argv);
+    fflush(stdout);
+    restore_redirects(r, saved, r->count);
+    return status;
+}
 
-        if (execvp(args[0], args) == -1)
-        {
-            perror(args[0]);
-        }
-        exit(EXIT_FAILURE);
-    } 
-    else if (pid < 0) perror("fork failed");
-    else
+/* Lista warunkowa p1 && p2 || p3 ... (potoki first..last) na pierwszym planie:
+   kolejny potok działa zależnie od statusu poprzedniego */
+int execute_and_or(const struct ast *t, int first, int last)
+{
+    const struct ast_pipeline *pl;
+    int k, connector;
+
+    for (k = first; k <= last && !exit_requested; k++)
     {
-        while (waitpid(pid, &status, 0) == -1)
-        {
-            if (errno != EINTR)
-            {
-                perror("waitpid");
-                break;
-            }
-        }
+        pl = &t->pipelines[k];
+        connector = k > first ? t->pipelines[k - 1].connector : AST_SEQ;
+        if ((connector == AST_AND && last_status != 0) || (connector == AST_OR && last_status == 0)) continue;
+        last_status = pl->count == 1 ? execute_simple(&pl->commands[0], pl->text) : execute_pipeline(pl, 0);
     }
+    return last_status;
 }
 
-/* Wywołanie odpowiednich funkcji */
-int execute_command(char **args) 
+/* Lista warunkowa w tle: pojedynczy potok jako zwykłe zadanie, dłuższa lista
+   w podpowłoce (fork) jako jedno zadanie */
+int execute_background(const struct ast *t, int first, int last)
 {
-    if (args[0] == NULL) return 1;
-    if (strcmp(args[0], "exit") == 0) return 0;
-    if (strcmp(args[0], "cd") == 0) { builtin_cd(args); return 1; }
-    if (strcmp(args[0], "help") == 0) { builtin_help(); return 1; }
-    if (strcmp(args[0], "clear") == 0) { builtin_clear(); return 1; }
-    if (strcmp(args[0], "history") == 0) {builtin_history(); return 1;}
-    if (strcmp(args[0], "cp") == 0) { builtin_cp(args); return 1; }
-    if (strcmp(args[0], "touch") == 0) { builtin_touch(args); return 1; }
-    if (strcmp(args[0], "stat") == 0) { builtin_stat(args); return 1; }
+    sigset_t prev;
+    char *text;
+    size_t size = 1;
+    pid_t pid;
+    int k, status;
 
-    execute_external(args);
-    return 1;
+    if (first == last) return execute_pipeline(&t->pipelines[first], 1);
+
+    for (k = first; k <= last; k++) size += strlen(t->pipelines[k].text) + 4;
+    text = arena_alloc(&cmd_arena, size);
+    text[0] = '\0';
+    for (k = first; k <= last; k++)
+    {
+        strcat(text, t->pipelines[k].text);
+        if (k < last) strcat(text, t->pipelines[k].connector == AST_AND ? " && " : " || ");
+    }
+
+    sigchld_block(&prev);
+    fflush(stdout);
+    pid = fork();
+    if (pid == 0)
+    {
+        /* Podpowłoka: własne (puste) zadania, bez przekazywania terminala */
+        if (job_control) setpgid(0, 0);
+        job_control = 0;
+        memset(job_table, 0, sizeof(job_table));
+        child_signals();
+        status = execute_and_or(t, first, last);
+        fflush(stdout);
+        _exit(status);
+    }
+    if (pid < 0)
+    {
+        perror("fork failed");
+        sigprocmask(SIG_SETMASK, &prev, NULL);
+        return 1;
+    }
+    if (job_control) setpgid(pid, pid);
+    status = job_launch(&pid, 1, text, 1);
+    sigprocmask(SIG_SETMASK, &prev, NULL);
+    return status;
+}
+
+/* Wykonanie drzewa linii: listy rozdzielone ; i & (te w tle), w każdej && i ||;
+   zwraca 0, gdy powłoka ma się zakończyć */
+int execute_command(const struct ast *t)
+{
+    int first = 0, k;
+
+    for (k = 0; k < t->count && !exit_requested; k++)
+    {
+        if (t->pipelines[k].connector == AST_AND || t->pipelines[k].connector == AST_OR) continue;
+        if (t->pipelines[k].connector == AST_BG) last_status = execute_background(t, first, k);
+        else execute_and_or(t, first, k);
+        first = k + 1;
+    }
+    return !exit_requested;
 }
 
 /* Obsługa CTRL+C */
 void sigint_handler(int signum)
 {
     (void)signum;
+    interrupted = 1;
     write(STDOUT_FILENO, "\n", 1);
 }
 
@@ -363,24 +4269,616 @@ void setup_signals()
         perror("sigaction");
         exit(EXIT_FAILURE);
     }
+
+    /* SIGCHLD: asynchroniczne zbieranie zadań; SA_RESTART, żeby nie przerywać fgets() */
+    sa.sa_handler = sigchld_handler;
+    sa.sa_flags = SA_RESTART;
+    if (sigaction(SIGCHLD, &sa, NULL) == -1)
+    {
+        perror("sigaction");
+        exit(EXIT_FAILURE);
+    }
+
+    /* Kontrola zadań tylko w trybie interaktywnym: powłoka we własnej grupie procesów,
+       na pierwszym planie terminala, odporna na CTRL+Z i sygnały terminala */
+    if (!isatty(STDIN_FILENO)) return;
+    while (tcgetpgrp(STDIN_FILENO) != (shell_pgid = getpgrp())) kill(-shell_pgid, SIGTTIN);
+    signal(SIGQUIT, SIG_IGN);
+    signal(SIGTSTP, SIG_IGN);
+    signal(SIGTTIN, SIG_IGN);
+    signal(SIGTTOU, SIG_IGN);
+    setpgid(0, 0);
+    shell_pgid = getpid();
+    job_control = tcsetpgrp(STDIN_FILENO, shell_pgid) == 0;
+}
+
+#ifdef MICROSHELL_BENCH
+/* Pomiary do odtworzenia liczb z opisów zmian: microshell-bench TRYB [ARGUMENTY] */
+
+/* Tryb pomiaru: nazwa, funkcja i opis argumentów */
+struct bench_mode
+{
+    const char *name;
+    int (*run)(char **args);
+    const char *usage;
+};
+
+/* Czas monotoniczny w sekundach */
+double bench_now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Jedno kopiowanie SRC -> DST daną metodą i rozmiarem kawałka (z fdatasync); czas albo -1 */
+double bench_copy_once(char *src, char *dst, int method, size_t chunk)
+{
+    struct cp_opts opts;
+    struct cp_file f;
+    struct stat st;
+    double start, elapsed;
+    int rc;
+
+    memset(&opts, 0, sizeof(opts));
+    f.src_fd = open(src, O_RDONLY);
+    if (f.src_fd == -1 || fstat(f.src_fd, &st) == -1) return -1;
+    f.dst_fd = open(dst, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (f.dst_fd == -1)
+    {
+        close(f.src_fd);
+        return -1;
+    }
+    f.method = method;
+    f.direct = 0;
+    f.verify = 0;
+    f.crc = 0xFFFFFFFFU;
+    f.chunk = chunk;
+    f.opts = &opts;
+
+    /* Źródło poza page cache (o ile jądro pozwoli), żeby mierzyć dysk, nie pamięć */
+    posix_fadvise(f.src_fd, 0, 0, POSIX_FADV_DONTNEED);
+    start = bench_now();
+    rc = copy_data(&f, 0, st.st_size);
+    if (rc == 0) rc = fdatasync(f.dst_fd);
+    elapsed = bench_now() - start;
+    close(f.src_fd);
+    close(f.dst_fd);
+    return rc == 0 ? elapsed : -1;
+}
+
+/* chunk PLIK [KATALOG]: przepustowość read/write i io_uring dla kolejnych rozmiarów kawałka
+   oraz dla rozmiaru wybranego przez cp_pick_chunk (najlepszy z trzech przebiegów) */
+int bench_chunk(char **args)
+{
+    static const size_t sizes[] = { 4 << 10, 16 << 10, 64 << 10, 256 << 10, 1 << 20, 4 << 20, 8 << 20, 16 << 20, 0 };
+    static const int methods[] = { CP_READ_WRITE, CP_IO_URING };
+    struct stat src_stat, dst_stat;
+    char *dst;
+    double best, t;
+    size_t chunk;
+    int i, m, run;
+
+    if (args[0] == NULL || stat(args[0], &src_stat) == -1 || !S_ISREG(src_stat.st_mode))
+    {
+        fprintf(stderr, "bench: chunk needs a regular file\n");
+        return 2;
+    }
+    dst = path_join(args[1] != NULL ? args[1] : ".", "microshell-bench.tmp");
+    if (dst == NULL || stat(args[1] != NULL ? args[1] : ".", &dst_stat) == -1)
+    {
+        perror("bench");
+        free(dst);
+        return 2;
+    }
+
+    printf("%ld MB, st_blksize %ld/%ld\n", (long)(src_stat.st_size >> 20), (long)src_stat.st_blksize, (long)dst_stat.st_blksize);
+    printf("%10s %14s %14s\n", "chunk", "read/write", "io_uring");
+    for (i = 0; i < (int)(sizeof(sizes) / sizeof(*sizes)); i++)
+    {
+        chunk = sizes[i] ? sizes[i] : cp_pick_chunk(&src_stat, &dst_stat, src_stat.st_size);
+        if (sizes[i]) printf("%9ldK", (long)(chunk >> 10));
+        else printf("auto %4ldK", (long)(chunk >> 10));
+        for (m = 0; m < 2; m++)
+        {
+            best = -1;
+            for (run = 0; run < 3; run++)
+            {
+                t = bench_copy_once(args[0], dst, methods[m], chunk);
+                if (t > 0 && (best < 0 || t < best)) best = t;
+            }
+            if (best > 0) printf(" %9.1f MB/s", src_stat.st_size / best / 1048576.0);
+            else printf(" %14s", "error");
+        }
+        printf("\n");
+    }
+    unlink(dst);
+    free(dst);
+    cp_release_buffer();
+    return 0;
+}
+
+/* Uruchomienie programu dawną ścieżką execute_external: fork(), SIGINT domyślny, execv() */
+pid_t bench_fork_exec(char **args)
+{
+    pid_t pid = fork();
+
+    if (pid == 0)
+    {
+        signal(SIGINT, SIG_DFL);
+        execv(args[0], args);
+        _exit(127);
+    }
+    return pid;
+}
+
+/* spawn [N] [MB]: średni czas uruchomienia i zebrania /bin/true przez fork+exec i przez
+   spawn_external (posix_spawn); MB zajętej pamięci udaje powłokę o większym rozmiarze */
+int bench_spawn(char **args)
+{
+    char *argv_true[2];
+    char *ballast = NULL;
+    long count = args[0] != NULL ? atol(args[0]) : 2000;
+    long mb = args[0] != NULL && args[1] != NULL ? atol(args[1]) : 0;
+    double start, elapsed[2];
+    pid_t pid;
+    long i;
+    int m, status;
+
+    argv_true[0] = "/bin/true";
+    argv_true[1] = NULL;
+    if (count < 1) count = 1;
+    if (mb > 0)
+    {
+        ballast = malloc((size_t)mb << 20);
+        if (ballast == NULL)
+        {
+            perror("bench");
+            return 2;
+        }
+        memset(ballast, 1, (size_t)mb << 20);
+    }
+
+    for (m = 0; m < 2; m++)
+    {
+        start = bench_now();
+        for (i = 0; i < count; i++)
+        {
+            pid = m == 0 ? bench_fork_exec(argv_true) : spawn_external(argv_true, -1, -1, NULL, -1);
+            if (pid == -1 || waitpid(pid, &status, 0) == -1)
+            {
+                perror("bench");
+                free(ballast);
+                return 1;
+            }
+        }
+        elapsed[m] = bench_now() - start;
+    }
+    printf("%ld x /bin/true, %ld MB resident\n", count, mb);
+    printf("fork+exec   %8.1f us\n", elapsed[0] / count * 1e6);
+    printf("posix_spawn %8.1f us\n", elapsed[1] / count * 1e6);
+    free(ballast);
+    return 0;
+}
+
+/* Odbiorca potoku jak wc -c: czyta do końca i odrzuca dane */
+pid_t bench_sink(int p[2])
+{
+    static char buffer[128 << 10];
+    pid_t pid = fork();
+
+    if (pid == 0)
+    {
+        close(p[1]);
+        while (read(p[0], buffer, sizeof(buffer)) > 0);
+        _exit(0);
+    }
+    return pid;
+}
+
+/* pipe PLIK: przepustowość PLIK | odbiorca osobno dla sposobu przesyłania (read/write
+   buforem 128 KB jak /bin/cat albo cat_fd, czyli splice) i rozmiaru potoku (domyślny
+   albo podniesiony przez F_SETPIPE_SZ jak w set -o bigpipe); najlepszy z trzech */
+int bench_pipe(char **args)
+{
+    static char buffer[128 << 10];
+    struct stat st;
+    double start, best, t;
+    ssize_t n, done, written;
+    pid_t pid;
+    int fd, p[2], big, m, run, rc;
+
+    if (args[0] == NULL || stat(args[0], &st) == -1 || !S_ISREG(st.st_mode))
+    {
+        fprintf(stderr, "bench: pipe needs a regular file\n");
+        return 2;
+    }
+    /* Plik w page cache: mierzony jest potok, nie dysk */
+    fd = open(args[0], O_RDONLY);
+    while (fd != -1 && read(fd, buffer, sizeof(buffer)) > 0);
+    if (fd != -1) close(fd);
+
+    printf("%ld MB\n%-14s %14s %14s\n", (long)(st.st_size >> 20), "pipe buffer", "read/write", "splice");
+    for (big = 0; big < 2; big++)
+    {
+        if (big) printf("%-14s", "F_SETPIPE_SZ");
+        else printf("%-14s", "default");
+        for (m = 0; m < 2; m++)
+        {
+            best = -1;
+            for (run = 0; run < 3; run++)
+            {
+                fd = open(args[0], O_RDONLY);
+                if (fd == -1 || pipe2(p, O_CLOEXEC) == -1)
+                {
+                    perror("bench");
+                    return 1;
+                }
+                if (big) fcntl(p[1], F_SETPIPE_SZ, pipe_max_size());
+                pid = bench_sink(p);
+                close(p[0]);
+
+                start = bench_now();
+                rc = 0;
+                if (m == 1) rc = cat_fd(fd, p[1]);
+                while (m == 0 && (n = read(fd, buffer, sizeof(buffer))) > 0)
+                {
+                    for (done = 0; done < n && rc == 0; done += written)
+                    {
+                        written = write(p[1], buffer + done, n - done);
+                        if (written == -1) rc = -1;
+                    }
+                }
+                close(p[1]);
+                waitpid(pid, NULL, 0);
+                t = bench_now() - start;
+                if (rc == 0 && (best < 0 || t < best)) best = t;
+                close(fd);
+            }
+            if (best > 0) printf(" %9.1f MB/s", st.st_size / best / 1048576.0);
+            else printf(" %14s", "error");
+        }
+        printf("\n");
+    }
+    return 0;
+}
+
+/* Wzorcowy podział na tokeny dla fuzz: te same reguły co parse_command, ale znak po znaku
+   i do osobnego bufora out (2 * strlen(line) + 2 bajtów); operator to wskaźnik op_*,
+   $? jako para (numer tokenu, przesunięcie) w marks (co najmniej strlen(line) / 2 par) */
+int bench_tokenize_ref(const char *line, char *out, char **toks, size_t *marks, int *nmarks)
+{
+    const char *p = line;
+    const char *op;
+    char quote = 0;
+    char *w = out, *start = NULL;
+    int n = 0, len;
+
+    *nmarks = 0;
+    while (*p)
+    {
+        if (quote == '\'')
+        {
+            if (*p == '\'') quote = 0;
+            else *w++ = *p;
+            p++;
+            continue;
+        }
+        if (quote == '"')
+        {
+            if (*p == '"') quote = 0;
+            else if (*p == '$' && p[1] == '?')
+            {
+                marks[2 * *nmarks] = n;
+                marks[2 * (*nmarks)++ + 1] = w - start;
+                p++;
+            }
+            else
+            {
+                if (*p == '\\' && p[1] != '\0' && strchr("\"\\$`", p[1]) != NULL) p++;
+                *w++ = *p;
+            }
+            p++;
+            continue;
+        }
+        if (*p == '\'' || *p == '"' || (*p == '\\' && p[1] != '\0') || (*p == '$' && p[1] == '?'))
+        {
+            if (start == NULL) start = w;
+            if (*p == '\'' || *p == '"')
+            {
+                quote = *p++;
+                continue;
+            }
+            if (*p == '\\') *w++ = p[1];
+            else
+            {
+                marks[2 * *nmarks] = n;
+                marks[2 * (*nmarks)++ + 1] = w - start;
+            }
+            p += 2;
+            continue;
+        }
+        op = *p == '2' && start != NULL ? NULL : parse_operator(p, &len);
+        if (parse_space(*p) || op != NULL)
+        {
+            if (start != NULL)
+            {
+                *w++ = '\0';
+                toks[n++] = start;
+                start = NULL;
+            }
+            if (op != NULL) toks[n++] = (char *)op;
+            p += op != NULL ? len : 1;
+            continue;
+        }
+        if (start == NULL) start = w;
+        *w++ = *p++;
+    }
+    if (start != NULL)
+    {
+        *w = '\0';
+        toks[n++] = start;
+    }
+    return n;
+}
+
+/* Generator pseudolosowy xorshift (powtarzalny dla danego ziarna) */
+unsigned long bench_random(unsigned long *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+/* fuzz [N] [ZIARNO]: N losowych linii z przewagą znaków specjalnych; parse_command musi dać
+   te same tokeny co bench_tokenize_ref, a słowa leżeć w buforze linii (ASan: -fsanitize=address) */
+int bench_fuzz(char **args)
+{
+    static const char alphabet[] = "ab2 \t'\"\\|&<>;$?x";
+    struct arena a;
+    struct param_marks params;
+    char **toks, **ref;
+    char *line, *copy, *out;
+    size_t *marks;
+    long count = args[0] != NULL ? atol(args[0]) : 100000;
+    unsigned long seed = args[0] != NULL && args[1] != NULL ? strtoul(args[1], NULL, 10) : 1;
+    unsigned long state = seed ? seed : 1;
+    size_t len, k;
+    long i;
+    int n, t, nmarks;
+
+    a.head = NULL;
+    for (i = 0; i < count; i++)
+    {
+        len = bench_random(&state) % 300;
+        line = malloc(len + 1);
+        copy = malloc(len + 1);
+        out = malloc(2 * len + 2);
+        ref = malloc((len + 1) * sizeof(*ref));
+        marks = malloc((len + 1) * sizeof(*marks));
+        if (line == NULL || copy == NULL || out == NULL || ref == NULL || marks == NULL)
+        {
+            perror("bench");
+            return 2;
+        }
+        for (k = 0; k < len; k++)
+        {
+            line[k] = bench_random(&state) % 4 ? alphabet[bench_random(&state) % (sizeof(alphabet) - 1)] : (char)(bench_random(&state) % 255 + 1);
+        }
+        line[len] = '\0';
+        memcpy(copy, line, len + 1);
+
+        n = bench_tokenize_ref(line, out, ref, marks, &nmarks);
+        arena_reset(&a);
+        toks = parse_command(copy, &a, &params);
+        for (t = 0; t < n && toks[t] != NULL; t++)
+        {
+            if (ref[t] >= out && ref[t] < out + 2 * len + 2)
+            {
+                /* Słowo: w buforze linii, za poprzednim, ten sam tekst */
+                if (toks[t] < copy || toks[t] + strlen(toks[t]) > copy + len || strcmp(toks[t], ref[t]) != 0) break;
+                if (t > 0 && toks[t - 1] >= copy && toks[t - 1] <= copy + len && toks[t] <= toks[t - 1]) break;
+            }
+            else if (toks[t] != ref[t]) break;
+        }
+        /* Znaczniki $?: to samo słowo (po numerze tokenu) i przesunięcie */
+        for (k = 0; t == n && toks[t] == NULL && (int)k < nmarks && nmarks == params.count; k++)
+        {
+            if (params.list[k].word != toks[marks[2 * k]] || params.list[k].offset != marks[2 * k + 1]) break;
+        }
+        if (t != n || toks[t] != NULL || nmarks != params.count || (int)k != nmarks)
+        {
+            printf("seed %lu, line %ld: token %d differs in \"", seed, i, t);
+            for (k = 0; k < len; k++) printf(line[k] >= ' ' && line[k] <= '~' ? "%c" : "\\x%02x", (unsigned char)line[k]);
+            printf("\"\n");
+            return 1;
+        }
+        free(line);
+        free(copy);
+        free(out);
+        free(ref);
+        free(marks);
+    }
+    arena_free(&a);
+    printf("%ld lines, seed %lu: ok\n", count, seed);
+    return 0;
+}
+
+/* Czas parse_command na kopii linii (ns na linię) przy około total bajtów przetworzonych */
+double bench_parse_rate(const char *line, double total)
+{
+    struct arena a;
+    struct param_marks params;
+    size_t len = strlen(line);
+    long i, rounds = (long)(total / (len + 1)) + 1;
+    char *copy = malloc(len + 1);
+    double start;
+
+    a.head = NULL;
+    if (copy == NULL) return -1;
+    start = bench_now();
+    for (i = 0; i < rounds; i++)
+    {
+        memcpy(copy, line, len + 1);
+        arena_reset(&a);
+        parse_command(copy, &a, &params);
+    }
+    start = (bench_now() - start) / rounds;
+    arena_free(&a);
+    free(copy);
+    return start * 1e9;
+}
+
+/* tokenize: przepustowość parse_command dla typowych linii oraz czas na bajt dla rosnącej
+   liczby cudzysłowów (stały przy koszcie liniowym) */
+int bench_tokenize(char **args)
+{
+    static const char *lines[] = {
+        "ls -la /usr/include/linux/fs.h | grep -n define > out.txt",
+        "echo \"a b\" 'c d' e\\ f \"x\\\"y\" $? 2>err.txt && cat <in.txt >>log || true; wait"
+    };
+    static const long quotes[] = { 1000, 10000, 100000 };
+    char *line;
+    double ns;
+    long q;
+    int i;
+
+    (void)args;
+    for (i = 0; i < 2; i++)
+    {
+        ns = bench_parse_rate(lines[i], 200e6);
+        printf("%-8s %4d B  %8.1f ns/line  %7.1f MB/s\n", i == 0 ? "plain" : "quoted", (int)strlen(lines[i]), ns,
+               strlen(lines[i]) / ns * 1e9 / 1048576.0);
+    }
+    for (i = 0; i < 3; i++)
+    {
+        line = malloc(quotes[i] * 3 + 1);
+        if (line == NULL) return 2;
+        for (q = 0; q < quotes[i]; q++) memcpy(line + 3 * q, "\"a\"", 3);
+        line[quotes[i] * 3] = '\0';
+        ns = bench_parse_rate(line, 200e6);
+        printf("%6ld x \"a\"  %10.1f ns/line  %7.2f ns/B\n", quotes[i], ns, ns / (quotes[i] * 3));
+        free(line);
+    }
+    return 0;
+}
+
+/* Przejście całej linii kolejnymi wywołaniami scan; liczba znalezionych znaków specjalnych */
+long bench_scan_all(const char *(*scan)(const char *, const char *), const char *p, const char *end)
+{
+    long found = 0;
+
+    while ((p = scan(p, end)) < end)
+    {
+        found++;
+        p++;
+    }
+    return found;
+}
+
+/* scan: linia 1 MB ze słów o długości 8, 64 i 512 bajtów; przepustowość scan_special_sw,
+   SSE2, AVX2 (gdy procesor ma) i całego parse_command, wyniki skanów muszą się zgadzać */
+int bench_scan(char **args)
+{
+    static const int words[] = { 8, 64, 512 };
+    static const char *names[] = { "scalar", "sse2", "avx2" };
+    const char *(*scans[3])(const char *, const char *);
+    size_t len = 1 << 20;
+    char *line;
+    double start, rate[4];
+    long found[3];
+    int i, m, nscans = 1, run;
+
+    (void)args;
+    scans[0] = scan_special_sw;
+#if defined(__x86_64__)
+    scans[nscans++] = scan_special_sse2;
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) scans[nscans++] = scan_special_avx2;
+#endif
+    line = malloc(len + 1);
+    if (line == NULL) return 2;
+
+    printf("%-10s", "1 MB line");
+    for (m = 0; m < nscans; m++) printf(" %12s", names[m]);
+    printf(" %12s\n", "parse");
+    for (i = 0; i < 3; i++)
+    {
+        memset(line, 'a', len);
+        for (m = words[i]; m < (int)len; m += words[i] + 1) line[m] = ' ';
+        line[len] = '\0';
+
+        for (m = 0; m < nscans; m++)
+        {
+            start = bench_now();
+            for (run = 0; run < 50; run++) found[m] = bench_scan_all(scans[m], line, line + len);
+            rate[m] = 50.0 * len / (bench_now() - start) / 1048576.0;
+            if (found[m] != found[0])
+            {
+                printf("%s: %ld special bytes, scalar found %ld\n", names[m], found[m], found[0]);
+                free(line);
+                return 1;
+            }
+        }
+        rate[nscans] = len / (bench_parse_rate(line, 50.0 * len) / 1e9) / 1048576.0;
+
+        printf("%4d B     ", words[i]);
+        for (m = 0; m <= nscans; m++) printf(" %7.0f MB/s", rate[m]);
+        printf("\n");
+    }
+    free(line);
+    return 0;
 }
 
+struct bench_mode bench_modes[] = {
+    { "chunk", bench_chunk, "FILE [DIR]" },
+    { "spawn", bench_spawn, "[COUNT] [RESIDENT_MB]" },
+    { "pipe", bench_pipe, "FILE" },
+    { "fuzz", bench_fuzz, "[COUNT] [SEED]" },
+    { "tokenize", bench_tokenize, "" },
+    { "scan", bench_scan, "" }
+};
+
+int main(int argc, char **argv)
+{
+    int i;
+
+    for (i = 0; argc >= 2 && i < (int)(sizeof(bench_modes) / sizeof(*bench_modes)); i++)
+    {
+        if (strcmp(argv[1], bench_modes[i].name) == 0) return bench_modes[i].run(argv + 2);
+    }
+    for (i = 0; i < (int)(sizeof(bench_modes) / sizeof(*bench_modes)); i++)
+    {
+        fprintf(stderr, "usage: %s %s %s\n", argv[0], bench_modes[i].name, bench_modes[i].usage);
+    }
+    return 2;
+}
+#else
 /* Funkcja main */
 int main()
 {
-    char input_buffer[MAX_CMD_LEN];
-    char *args[MAX_ARGS];
+    char *input_buffer;
+    struct ast *tree;
+    long arg_max = sysconf(_SC_ARG_MAX);
     int status = 1;
 
     setup_signals();
+    if (arg_max < ARENA_BLOCK_MIN) arg_max = ARENA_BLOCK_MIN;
 
     while (status)
     {
+        jobs_notify();
         type_prompt();
 
-        if (fgets(input_buffer, MAX_CMD_LEN, stdin) == NULL)
+        arena_reset(&cmd_arena);
+        /* EINTR liczy się tylko z błędu samego odczytu (sigsuspend w job_wait też je zostawia) */
+        errno = 0;
+        input_buffer = read_line(&cmd_arena, (size_t)arg_max);
+        if (input_buffer == NULL)
         {
-            if (errno == EINTR)
+            if (ferror(stdin) && errno == EINTR)
             {
                 errno = 0;
                 clearerr(stdin);
@@ -390,25 +4888,25 @@ int main()
             break;
         }
 
-        if (strchr(input_buffer, '\n') == NULL && !feof(stdin))
-        {
-            int c;
-            while ((c = getchar()) != '\n' && c != EOF);
-        }
-
-        input_buffer[strcspn(input_buffer, "\n")] = 0;
-
         if (strlen(input_buffer) == 0) continue;
         add_to_history(input_buffer);
-        parse_command(input_buffer, args);
-        status = execute_command(args);
+        tree = ast_lookup(input_buffer);
+        if (tree == NULL)
+        {
+            last_status = 2;
+            continue;
+        }
+        /* CTRL+C przy znaku zachęty nie może przerwać następnego polecenia */
+        interrupted = 0;
+        status = execute_command(tree);
     }
-    return 0;
+    return last_status;
 }
+#endif
 
 /* 
 CC = gcc
-CFLAGS = -Wall -ansi -pedantic
+CFLAGS = -Wall -ansi -pedantic -pthread
 TARGET = microshell
 
 all: $(TARGET)
@@ -416,6 +4914,9 @@ all: $(TARGET)
 $(TARGET): microshell.c
     $(CC) $(CFLAGS) -o $(TARGET) microshell.c
 
+bench: microshell.c
+    $(CC) $(CFLAGS) -O2 -DMICROSHELL_BENCH -o $(TARGET)-bench microshell.c
+
 clean:
-    rm -f $(TARGET)
+    rm -f $(TARGET) $(TARGET)-bench
 */
\ No newline at end of file